@@ -0,0 +1,701 @@
+// Host benchmark for cpp/supercluster.hpp.
+//
+// Builds a Supercluster index over synthetic datasets and measures the
+// construction time of every zoom level, the latency of the query methods and
+// the peak resident memory, optionally for several KD-tree precisions, and how
+// long saving, restoring and mapping a snapshot of the index takes. The report
+// is written as JSON (stdout by default) so that results can be diffed between
+// releases; progress goes to stderr.
+// A tracking run then moves a share of the points of a fixed set every tick,
+// as when clustering vehicles, comparing updatePositions() and the query of a
+// frame after it with a rebuild.
+//
+//   cmake -S benchmark -B build/benchmark && cmake --build build/benchmark
+//   ./build/benchmark/supercluster_benchmark --sizes 10000,100000 > report.json
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "supercluster.hpp"
+
+namespace {
+
+using mapbox::supercluster::IndexPrecision;
+using mapbox::supercluster::Options;
+using mapbox::supercluster::Supercluster;
+using Feature = mapbox::feature::feature<double>;
+using Features = mapbox::feature::feature_collection<double>;
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+  std::vector<std::string> datasets{"uniform", "hotspots", "duplicates"};
+  std::vector<std::size_t> sizes{10000, 100000, 1000000, 10000000};
+  std::size_t queries = 1000;
+  std::uint64_t seed = 42;
+  std::vector<IndexPrecision> precisions{IndexPrecision::Double};
+  Options options;
+  std::string output;
+  // tracking run: points, share of them moved per tick, ticks (0 to skip)
+  std::size_t trackingPoints = 50000;
+  double trackingMoving = 0.1;
+  std::size_t ticks = 100;
+};
+
+const char *precisionName(IndexPrecision precision) {
+  switch(precision) {
+    case IndexPrecision::Float:
+      return "float";
+    case IndexPrecision::Quantized:
+      return "quantized";
+    default:
+      return "double";
+  }
+}
+
+IndexPrecision parsePrecision(const std::string &name) {
+  if(name == "double") return IndexPrecision::Double;
+  if(name == "float") return IndexPrecision::Float;
+  if(name == "quantized") return IndexPrecision::Quantized;
+  throw std::invalid_argument("unknown precision " + name);
+}
+
+double elapsedMs(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// Minimal streaming JSON writer, enough for a flat report.
+class JsonWriter {
+ public:
+  explicit JsonWriter(std::ostream &out) : out(out) {}
+
+  void beginObject() { open('{'); }
+  void endObject() { close('}'); }
+  void beginArray() { open('['); }
+  void endArray() { close(']'); }
+
+  void key(const std::string &name) {
+    separate();
+    out << '"' << name << "\":";
+    afterKey = true;
+  }
+
+  void value(const std::string &v) {
+    separate();
+    out << '"' << v << '"';
+  }
+  void value(const char *v) { value(std::string(v)); }
+  void value(double v) {
+    separate();
+    if(std::isfinite(v)) {
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%.3f", v);
+      out << buf;
+    } else {
+      out << "null";
+    }
+  }
+  void value(std::uint64_t v) {
+    separate();
+    out << v;
+  }
+  void value(std::int64_t v) {
+    separate();
+    out << v;
+  }
+  void value(int v) { value(static_cast<std::int64_t>(v)); }
+  void value(bool v) {
+    separate();
+    out << (v ? "true" : "false");
+  }
+
+  template <typename T>
+  void field(const std::string &name, const T &v) {
+    key(name);
+    value(v);
+  }
+
+ private:
+  std::ostream &out;
+  std::vector<bool> hasItems;
+  bool afterKey = false;
+
+  void separate() {
+    if(afterKey) {
+      afterKey = false;
+      return;
+    }
+    if(!hasItems.empty()) {
+      if(hasItems.back()) out << ',';
+      hasItems.back() = true;
+    }
+  }
+  void open(char c) {
+    separate();
+    out << c;
+    hasItems.push_back(false);
+  }
+  void close(char c) {
+    hasItems.pop_back();
+    out << c;
+  }
+};
+
+// Peak RSS is tracked per dataset by resetting the kernel's high water mark
+// (VmHWM) before each run. Falls back to the process-wide getrusage() peak
+// when /proc is not available.
+void resetPeakRss() {
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  if(clearRefs) clearRefs << "5";
+}
+
+std::int64_t readProcStatusKb(const char *field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  const std::size_t length = std::strlen(field);
+  while(std::getline(status, line)) {
+    if(line.compare(0, length, field) == 0 && line.size() > length &&
+       line[length] == ':') {
+      return std::strtoll(line.c_str() + length + 1, nullptr, 10);
+    }
+  }
+  return -1;
+}
+
+std::int64_t peakRssKb() {
+  const auto hwm = readProcStatusKb("VmHWM");
+  if(hwm >= 0) return hwm;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+Feature makeFeature(double lng, double lat, std::size_t index) {
+  Feature feature{mapbox::geometry::point<double>(lng, lat)};
+  // same shape as the features produced by parseJSIFeature()
+  feature.properties["_clusterer_index"] = std::uint64_t(index);
+  return feature;
+}
+
+Features generateDataset(const std::string &name, std::size_t size,
+                         std::uint64_t seed) {
+  Features features;
+  features.reserve(size);
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> lngDist(-180.0, 180.0);
+  std::uniform_real_distribution<double> latDist(-85.0, 85.0);
+
+  if(name == "uniform") {
+    for(std::size_t i = 0; i < size; i++) {
+      const double lng = lngDist(rng);
+      features.push_back(makeFeature(lng, latDist(rng), i));
+    }
+  } else if(name == "hotspots") {
+    // gaussian blobs of varying spread around a few city-like centers
+    const std::size_t numHotspots = 64;
+    std::vector<std::array<double, 3>> hotspots;
+    std::uniform_real_distribution<double> sigmaDist(0.05, 3.0);
+    for(std::size_t h = 0; h < numHotspots; h++) {
+      const double lng = lngDist(rng);
+      const double lat = std::uniform_real_distribution<double>(-60, 60)(rng);
+      hotspots.push_back({lng, lat, sigmaDist(rng)});
+    }
+    std::normal_distribution<double> normal(0.0, 1.0);
+    for(std::size_t i = 0; i < size; i++) {
+      const auto &h = hotspots[rng() % numHotspots];
+      const double lng =
+          std::max(-180.0, std::min(180.0, h[0] + normal(rng) * h[2]));
+      const double lat =
+          std::max(-85.0, std::min(85.0, h[1] + normal(rng) * h[2]));
+      features.push_back(makeFeature(lng, lat, i));
+    }
+  } else if(name == "duplicates") {
+    // ~100 points share every location
+    const std::size_t numLocations = std::max<std::size_t>(1, size / 100);
+    std::vector<std::pair<double, double>> locations;
+    locations.reserve(numLocations);
+    for(std::size_t l = 0; l < numLocations; l++) {
+      const double lng = lngDist(rng);
+      locations.emplace_back(lng, latDist(rng));
+    }
+    for(std::size_t i = 0; i < size; i++) {
+      const auto &l = locations[rng() % numLocations];
+      features.push_back(makeFeature(l.first, l.second, i));
+    }
+  } else {
+    throw std::invalid_argument("unknown dataset: " + name);
+  }
+  return features;
+}
+
+struct Latency {
+  std::vector<double> samplesUs;
+
+  template <typename TFn>
+  void measure(const TFn &fn) {
+    const auto start = Clock::now();
+    fn();
+    samplesUs.push_back(
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count());
+  }
+
+  double percentile(std::vector<double> &sorted, double p) const {
+    if(sorted.empty()) return NAN;
+    const auto rank = static_cast<std::size_t>(
+        std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+    return sorted[std::min(sorted.size() - 1, rank == 0 ? 0 : rank - 1)];
+  }
+
+  void write(JsonWriter &json) const {
+    std::vector<double> sorted(samplesUs);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    for(const auto s : sorted) sum += s;
+
+    json.beginObject();
+    json.field("count", static_cast<std::uint64_t>(sorted.size()));
+    json.field("mean_us", sorted.empty() ? NAN : sum / sorted.size());
+    json.field("p50_us", percentile(sorted, 50));
+    json.field("p90_us", percentile(sorted, 90));
+    json.field("p99_us", percentile(sorted, 99));
+    json.field("max_us", sorted.empty() ? NAN : sorted.back());
+    json.endObject();
+  }
+};
+
+std::uint32_t lngToTileX(double lng, std::uint32_t z2) {
+  const double x = (lng + 180.0) / 360.0 * z2;
+  return std::min(z2 - 1, static_cast<std::uint32_t>(std::max(0.0, x)));
+}
+
+std::uint32_t latToTileY(double lat, std::uint32_t z2) {
+  const double sine = std::sin(lat * M_PI / 180.0);
+  const double y =
+      (0.5 - 0.25 * std::log((1 + sine) / (1 - sine)) / M_PI) * z2;
+  return std::min(z2 - 1, static_cast<std::uint32_t>(std::max(0.0, y)));
+}
+
+void runDataset(const Config &config, const std::string &dataset,
+                std::size_t size, IndexPrecision precision, JsonWriter &json) {
+  std::cerr << dataset << " " << size << " " << precisionName(precision)
+            << ": generating" << std::flush;
+  const Features features = generateDataset(dataset, size, config.seed);
+
+  resetPeakRss();
+  const auto rssBefore = readProcStatusKb("VmRSS");
+
+  struct ZoomTiming {
+    int zoom;
+    std::size_t clusters;
+    double ms;
+  };
+  std::vector<ZoomTiming> zoomTimings;
+  Options options = config.options;
+  options.precision = precision;
+  auto levelStart = Clock::now();
+  const auto buildStart = levelStart;
+  // levels built lazily by queries are part of the query latencies
+  bool building = true;
+  options.onZoomIndexed = [&](std::uint8_t zoom, std::size_t clusters) {
+    if(!building) return;
+    const auto now = Clock::now();
+    zoomTimings.push_back({zoom, clusters, elapsedMs(levelStart, now)});
+    levelStart = now;
+  };
+
+  std::cerr << ", building" << std::flush;
+  Supercluster index(features, options);
+  building = false;
+  const double buildMs = elapsedMs(buildStart, Clock::now());
+  const auto rssAfterBuild = readProcStatusKb("VmRSS");
+
+  std::cerr << " (" << buildMs << "ms), querying" << std::flush;
+  std::mt19937_64 rng(config.seed + 1);
+  const int minZoom = config.options.minZoom;
+  const int maxZoom = config.options.maxZoom;
+  std::uniform_int_distribution<int> queryZoom(minZoom, maxZoom + 1);
+  std::uniform_int_distribution<int> tileZoom(minZoom, maxZoom);
+  std::size_t sink = 0;
+  const std::size_t numQueries = features.empty() ? 0 : config.queries;
+
+  // viewport queries: a 1024x1024px screen centered on a random input point
+  Latency getClusters;
+  for(std::size_t q = 0; q < numQueries; q++) {
+    const int z = queryZoom(rng);
+    const auto &center = features[rng() % features.size()]
+                             .geometry.get<mapbox::geometry::point<double>>();
+    const double halfLng = 180.0 * 1024.0 / (256.0 * std::pow(2.0, z));
+    const double halfLat = std::min(85.0, halfLng);
+    double bbox[4] = {center.x - halfLng, std::max(-85.0, center.y - halfLat),
+                      center.x + halfLng, std::min(85.0, center.y + halfLat)};
+    getClusters.measure(
+        [&] { sink += index.getClusters(bbox, static_cast<std::uint8_t>(z)).size(); });
+  }
+
+  Latency getTile;
+  for(std::size_t q = 0; q < numQueries; q++) {
+    const int z = tileZoom(rng);
+    const std::uint32_t z2 = 1u << z;
+    const auto &p = features[rng() % features.size()]
+                        .geometry.get<mapbox::geometry::point<double>>();
+    const auto x = lngToTileX(p.x, z2);
+    const auto y = latToTileY(p.y, z2);
+    getTile.measure([&] {
+      sink += index.getTile(static_cast<std::uint8_t>(z), x, y).size();
+    });
+  }
+
+  // collect a sample of cluster ids and point counts across all zoom levels
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> clusterIds;
+  for(int z = minZoom; z <= maxZoom; z++) {
+    double world[4] = {-180, -90, 180, 90};
+    for(const auto &f : index.getClusters(world, static_cast<std::uint8_t>(z))) {
+      const auto it = f.properties.find("cluster_id");
+      if(it != f.properties.end())
+        clusterIds.emplace_back(
+            static_cast<std::uint32_t>(it->second.get<std::uint64_t>()),
+            static_cast<std::uint32_t>(
+                f.properties.at("point_count").get<std::uint64_t>()));
+    }
+  }
+  std::shuffle(clusterIds.begin(), clusterIds.end(), rng);
+  if(clusterIds.size() > config.queries) clusterIds.resize(config.queries);
+
+  Latency getChildren, getLeaves, getLeavesLastPage, getClusterExpansionZoom,
+      getClusterBounds;
+  for(const auto &[id, count] : clusterIds) {
+    getChildren.measure([&] { sink += index.getChildren(id).size(); });
+    getLeaves.measure([&] { sink += index.getLeaves(id).size(); });
+    getLeavesLastPage.measure([&] {
+      sink += index.getLeaves(id, 10, count > 10 ? count - 10 : 0).size();
+    });
+    getClusterExpansionZoom.measure(
+        [&] { sink += index.getClusterExpansionZoom(id); });
+    getClusterBounds.measure(
+        [&] { sink += index.getClusterBounds(id)[0] < 0; });
+  }
+  const auto peakRss = peakRssKb();
+
+  // a snapshot restores the index without clustering again
+  const auto serializeStart = Clock::now();
+  const std::string snapshot = index.serialize();
+  const double serializeMs = elapsedMs(serializeStart, Clock::now());
+  const auto deserializeStart = Clock::now();
+  sink += Supercluster::deserialize(snapshot.data(), snapshot.size(), options)
+              ->memoryUsage()
+              .count;
+  const double deserializeMs = elapsedMs(deserializeStart, Clock::now());
+  // a mapped snapshot file is queried in place instead of being read
+  const auto snapshotPath = (std::filesystem::temp_directory_path() /
+                             "supercluster_benchmark.snapshot")
+                                .string();
+  std::ofstream(snapshotPath, std::ios::binary)
+      .write(snapshot.data(), static_cast<std::streamsize>(snapshot.size()));
+  const auto mapStart = Clock::now();
+  sink += Supercluster::mapSnapshot(snapshotPath, options)->memoryUsage().count;
+  const double mapMs = elapsedMs(mapStart, Clock::now());
+  std::remove(snapshotPath.c_str());
+  std::cerr << ", done (" << sink << ")\n";
+
+  json.beginObject();
+  json.field("dataset", dataset);
+  json.field("points", static_cast<std::uint64_t>(size));
+  json.field("precision", precisionName(precision));
+
+  json.key("build");
+  json.beginObject();
+  json.field("total_ms", buildMs);
+  json.key("zooms");
+  json.beginArray();
+  for(const auto &t : zoomTimings) {
+    json.beginObject();
+    json.field("zoom", t.zoom);
+    json.field("clusters", static_cast<std::uint64_t>(t.clusters));
+    json.field("ms", t.ms);
+    json.endObject();
+  }
+  json.endArray();
+  json.key("snapshot");
+  json.beginObject();
+  json.field("bytes", static_cast<std::uint64_t>(snapshot.size()));
+  json.field("serialize_ms", serializeMs);
+  json.field("deserialize_ms", deserializeMs);
+  json.field("map_ms", mapMs);
+  json.endObject();
+  json.endObject();
+
+  json.key("queries");
+  json.beginObject();
+  json.key("getClusters");
+  getClusters.write(json);
+  json.key("getTile");
+  getTile.write(json);
+  json.key("getChildren");
+  getChildren.write(json);
+  json.key("getLeaves");
+  getLeaves.write(json);
+  json.key("getLeavesLastPage");
+  getLeavesLastPage.write(json);
+  json.key("getClusterExpansionZoom");
+  getClusterExpansionZoom.write(json);
+  json.key("getClusterBounds");
+  getClusterBounds.write(json);
+  const auto tileCache = index.tileCacheStats();
+  json.key("tileCache");
+  json.beginObject();
+  json.field("hits", static_cast<std::uint64_t>(tileCache.hits));
+  json.field("misses", static_cast<std::uint64_t>(tileCache.misses));
+  json.field("tiles", static_cast<std::uint64_t>(tileCache.tiles));
+  json.field("bytes", static_cast<std::uint64_t>(tileCache.bytes));
+  json.endObject();
+  json.endObject();
+
+  json.key("memory");
+  json.beginObject();
+  json.field("rss_before_kb", rssBefore);
+  json.field("rss_after_build_kb", rssAfterBuild);
+  json.field("peak_rss_kb", peakRss);
+  const auto usage = index.memoryUsage();
+  json.field("clusters", static_cast<std::uint64_t>(usage.count));
+  json.field("clusters_bytes", static_cast<std::uint64_t>(usage.clusters));
+  json.field("trees_bytes", static_cast<std::uint64_t>(usage.trees));
+  json.field("bytes_per_cluster",
+             usage.count == 0 ? NAN
+                              : double(usage.clusters + usage.trees) / usage.count);
+  json.endObject();
+
+  json.endObject();
+}
+
+// Vehicles: a hotspots dataset loaded as coordinates with ids, of which a
+// random share drives a few meters every tick.
+void runTracking(const Config &config, JsonWriter &json) {
+  const auto size = config.trackingPoints;
+  const auto moving = static_cast<std::size_t>(
+      std::ceil(config.trackingMoving * static_cast<double>(size)));
+  std::cerr << "tracking " << size << ", " << moving << " moving per tick"
+            << std::flush;
+
+  const Features features =
+      generateDataset("hotspots", size, config.seed + 2);
+  std::vector<double> lngLat;
+  std::vector<std::uint32_t> ids;
+  lngLat.reserve(2 * size);
+  ids.reserve(size);
+  for(std::size_t i = 0; i < size; i++) {
+    const auto &p = features[i].geometry.get<mapbox::geometry::point<double>>();
+    lngLat.push_back(p.x);
+    lngLat.push_back(p.y);
+    ids.push_back(static_cast<std::uint32_t>(i));
+  }
+
+  Supercluster index(lngLat.data(), size, ids.data(), config.options);
+  std::mt19937_64 rng(config.seed + 3);
+  // about 10m per second
+  std::normal_distribution<double> step(0.0, 0.0001);
+  std::vector<std::uint32_t> movedIds(moving);
+  std::vector<double> movedLngLat(2 * moving);
+
+  const std::uint8_t frameZoom = 10;
+  Latency updatePositions, frame, rebuild;
+  std::size_t sink = 0;
+  for(std::size_t tick = 0; tick < config.ticks && size > 0; tick++) {
+    for(std::size_t k = 0; k < moving; k++) {
+      const auto i = static_cast<std::uint32_t>(rng() % size);
+      lngLat[2 * i] = std::max(-180.0, std::min(180.0, lngLat[2 * i] + step(rng)));
+      lngLat[2 * i + 1] =
+          std::max(-85.0, std::min(85.0, lngLat[2 * i + 1] + step(rng)));
+      movedIds[k] = i;
+      movedLngLat[2 * k] = lngLat[2 * i];
+      movedLngLat[2 * k + 1] = lngLat[2 * i + 1];
+    }
+    // a map showing the clusters around the first moved point, the zoom
+    // levels are brought up to date by the query
+    double view[4] = {movedLngLat[0] - 0.5, movedLngLat[1] - 0.5,
+                      movedLngLat[0] + 0.5, movedLngLat[1] + 0.5};
+    updatePositions.measure([&] {
+      sink += index.updatePositions(movedIds.data(), movedLngLat.data(),
+                                    moving);
+    });
+    frame.measure([&] { sink += index.getClusters(view, frameZoom).size(); });
+    // the alternative, loading the moved fleet again
+    if(tick % 10 == 0) {
+      rebuild.measure([&] {
+        Supercluster fresh(lngLat.data(), size, ids.data(), config.options);
+        sink += fresh.getClusters(view, frameZoom).size();
+      });
+    }
+  }
+  std::cerr << ", done (" << sink << ")\n";
+
+  json.beginObject();
+  json.field("points", static_cast<std::uint64_t>(size));
+  json.field("moving", static_cast<std::uint64_t>(moving));
+  json.field("ticks", static_cast<std::uint64_t>(config.ticks));
+  json.field("frameZoom", static_cast<std::uint64_t>(frameZoom));
+  json.key("updatePositions");
+  updatePositions.write(json);
+  json.key("frame");
+  frame.write(json);
+  json.key("rebuild");
+  rebuild.write(json);
+  json.endObject();
+}
+
+std::vector<std::string> splitList(const std::string &list) {
+  std::vector<std::string> items;
+  std::stringstream ss(list);
+  std::string item;
+  while(std::getline(ss, item, ','))
+    if(!item.empty()) items.push_back(item);
+  return items;
+}
+
+void printUsage() {
+  std::cerr
+      << "usage: supercluster_benchmark [options]\n"
+         "  --datasets LIST   comma separated: uniform,hotspots,duplicates\n"
+         "  --sizes LIST      comma separated point counts "
+         "(default 10000,100000,1000000,10000000)\n"
+         "  --queries N       samples per query type (default 1000)\n"
+         "  --seed N          random seed (default 42)\n"
+         "  --radius N --extent N --min-zoom N --max-zoom N --min-points N\n"
+         "  --threads N       threads used to build the index (default 1)\n"
+         "  --precision LIST  comma separated KD-tree precisions: "
+         "double,float,quantized\n"
+         "                    (default double)\n"
+         "  --tile-cache N    bytes of the getTile cache (default 0, off)\n"
+         "  --lazy-zooms 0|1  build zoom levels on first query (default 0)\n"
+         "  --tracking-points N  points of the tracking run (default 50000)\n"
+         "  --tracking-moving F  share of them moved per tick (default 0.1)\n"
+         "  --ticks N         ticks of the tracking run, 0 to skip "
+         "(default 100)\n"
+         "  --output FILE     write the JSON report to FILE instead of "
+         "stdout\n";
+}
+
+Config parseArgs(int argc, char **argv) {
+  Config config;
+  for(int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if(arg == "--help" || arg == "-h") {
+      printUsage();
+      std::exit(0);
+    }
+    if(i + 1 >= argc) {
+      printUsage();
+      throw std::invalid_argument("missing value for " + arg);
+    }
+    const std::string value = argv[++i];
+    if(arg == "--datasets") {
+      config.datasets = splitList(value);
+    } else if(arg == "--sizes") {
+      config.sizes.clear();
+      for(const auto &s : splitList(value))
+        config.sizes.push_back(std::stoull(s));
+    } else if(arg == "--queries") {
+      config.queries = std::stoull(value);
+    } else if(arg == "--seed") {
+      config.seed = std::stoull(value);
+    } else if(arg == "--radius") {
+      config.options.radius = static_cast<std::uint16_t>(std::stoul(value));
+    } else if(arg == "--extent") {
+      config.options.extent = static_cast<std::uint16_t>(std::stoul(value));
+    } else if(arg == "--min-zoom") {
+      config.options.minZoom = static_cast<std::uint8_t>(std::stoul(value));
+    } else if(arg == "--max-zoom") {
+      config.options.maxZoom = static_cast<std::uint8_t>(std::stoul(value));
+    } else if(arg == "--min-points") {
+      config.options.minPoints = std::stoull(value);
+    } else if(arg == "--threads") {
+      config.options.threads = std::stoull(value);
+    } else if(arg == "--tile-cache") {
+      config.options.tileCacheSize = std::stoull(value);
+    } else if(arg == "--lazy-zooms") {
+      config.options.lazyZooms = std::stoul(value) != 0;
+    } else if(arg == "--tracking-points") {
+      config.trackingPoints = std::stoull(value);
+    } else if(arg == "--tracking-moving") {
+      config.trackingMoving = std::stod(value);
+    } else if(arg == "--ticks") {
+      config.ticks = std::stoull(value);
+    } else if(arg == "--precision") {
+      config.precisions.clear();
+      for(const auto &name : splitList(value))
+        config.precisions.push_back(parsePrecision(name));
+    } else if(arg == "--output") {
+      config.output = value;
+    } else {
+      printUsage();
+      throw std::invalid_argument("unknown option " + arg);
+    }
+  }
+  return config;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  try {
+    const Config config = parseArgs(argc, argv);
+
+    std::ofstream file;
+    if(!config.output.empty()) file.open(config.output);
+    std::ostream &out = config.output.empty() ? std::cout : file;
+
+    JsonWriter json(out);
+    json.beginObject();
+    json.field("format", 1);
+
+    json.key("options");
+    json.beginObject();
+    json.field("minZoom", static_cast<int>(config.options.minZoom));
+    json.field("maxZoom", static_cast<int>(config.options.maxZoom));
+    json.field("radius", static_cast<int>(config.options.radius));
+    json.field("extent", static_cast<int>(config.options.extent));
+    json.field("minPoints",
+               static_cast<std::uint64_t>(config.options.minPoints));
+    json.field("threads", static_cast<std::uint64_t>(config.options.threads));
+    json.field("tileCacheSize",
+               static_cast<std::uint64_t>(config.options.tileCacheSize));
+    json.field("lazyZooms", config.options.lazyZooms);
+    json.field("queries", static_cast<std::uint64_t>(config.queries));
+    json.field("seed", config.seed);
+    json.endObject();
+
+    json.key("results");
+    json.beginArray();
+    for(const auto &dataset : config.datasets)
+      for(const auto size : config.sizes)
+        for(const auto precision : config.precisions)
+          runDataset(config, dataset, size, precision, json);
+    json.endArray();
+
+    if(config.ticks > 0) {
+      json.key("tracking");
+      runTracking(config, json);
+    }
+
+    json.endObject();
+    out << "\n";
+  } catch(const std::exception &e) {
+    std::cerr << "supercluster_benchmark: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -1,6 +1,10 @@
 #include "HybridClusterer.hpp"
 
+#include <NitroModules/Dispatcher.hpp>
+#include <thread>
+
 #include "jsiHelpers.hpp"
+#include "vectorTile.hpp"
 
 namespace margelo::nitro::clusterer {
 jsi::Value HybridClusterer::load(jsi::Runtime &rt, const jsi::Value &_,
@@ -8,25 +12,79 @@ jsi::Value HybridClusterer::load(jsi::Runtime &rt, const jsi::Value &_,
   if(count != 2)
     throw jsi::JSError(rt, "React-Native-Clusterer: expects 2 arguments");
 
+  // jsi options to cpp, first as they select the point properties to read
+  mapbox::supercluster::Options options;
+  parseJSIOptions(rt, options, args[1]);
+  const auto numericProperties = aggregatedProperties(options);
+  cancelPendingLoad(rt);
+
   // jsi features to cpp
   mapbox::feature::feature_collection<double> features;
 
   if(args[0].isObject() && args[0].asObject(rt).isArray(rt)) {
-    featuresInput = args[0].asObject(rt).asArray(rt);
-    for(int i = 0; i < featuresInput->size(rt); i++) {
+    auto input = args[0].asObject(rt).asArray(rt);
+    for(int i = 0; i < input.size(rt); i++) {
       mapbox::feature::feature<double> feature;
-      parseJSIFeature(rt, i, feature, featuresInput->getValueAtIndex(rt, i));
+      parseJSIFeature(rt, i, feature, input.getValueAtIndex(rt, i),
+                      numericProperties);
       features.push_back(feature);
     }
+    featuresInput.emplace(rt, std::move(input));
   } else {
     throw jsi::JSError(rt, "Expected array of GeoJSON Feature objects");
   }
-  // jsi options to cpp
+
+  try {
+    instance = new mapbox::supercluster::Supercluster(features, options);
+  } catch(exception &e) {
+    std::string message =
+        std::string("React-Native-Clusterer: Error creating Supercluser") +
+        e.what();
+    throw jsi::JSError(rt, message.c_str());
+  }
+
+  return jsi::Value();
+}
+
+jsi::Value HybridClusterer::loadCoordinates(jsi::Runtime &rt,
+                                            const jsi::Value &_,
+                                            const jsi::Value *args,
+                                            size_t count) {
+  if(count < 2 || count > 3)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: loadCoordinates "
+                       "expects 2 or 3 arguments");
+
   mapbox::supercluster::Options options;
   parseJSIOptions(rt, options, args[1]);
+  cancelPendingLoad(rt);
+
+  // the typed arrays are copied with a memcpy, points are not visited in JS
+  size_t length = 0;
+  auto lngLat = reinterpret_cast<const double *>(
+      typedArrayData(rt, args[0], "Float64Array", length));
+  if(length % 2 != 0)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: loadCoordinates expects "
+                       "longitude / latitude pairs");
+
+  const std::uint32_t *ids = nullptr;
+  if(count == 3 && !args[2].isUndefined()) {
+    size_t idsLength = 0;
+    ids = reinterpret_cast<const std::uint32_t *>(
+        typedArrayData(rt, args[2], "Uint32Array", idsLength));
+    if(idsLength != length / 2)
+      throw jsi::JSError(rt,
+                         "React-Native-Clusterer: loadCoordinates expects "
+                         "one id per point");
+  }
+
+  // points have no JS features to take the properties from
+  featuresInput.emplace(rt, jsi::Array(rt, 0));
 
   try {
-    instance = new mapbox::supercluster::Supercluster(features, options);
+    instance = new mapbox::supercluster::Supercluster(lngLat, length / 2, ids,
+                                                      options);
   } catch(exception &e) {
     std::string message =
         std::string("React-Native-Clusterer: Error creating Supercluser") +
@@ -37,6 +95,324 @@ jsi::Value HybridClusterer::load(jsi::Runtime &rt, const jsi::Value &_,
   return jsi::Value();
 }
 
+jsi::Value HybridClusterer::loadAsync(jsi::Runtime &rt, const jsi::Value &_,
+                                      const jsi::Value *args, size_t count) {
+  if(count < 2 || count > 3)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: loadAsync "
+                       "expects 2 or 3 arguments");
+
+  mapbox::supercluster::Options options;
+  parseJSIOptions(rt, options, args[1]);
+  cancelPendingLoad(rt);
+
+  // only what the index needs is read on the JS thread: coordinates and the
+  // aggregated properties of features, or a copy of the typed arrays
+  mapbox::feature::feature_collection<double> features;
+  std::vector<double> lngLat;
+  std::vector<std::uint32_t> ids;
+  const bool coordinates =
+      !args[0].isObject() || !args[0].asObject(rt).isArray(rt);
+
+  if(!coordinates) {
+    const auto numericProperties = aggregatedProperties(options);
+    auto input = args[0].asObject(rt).asArray(rt);
+    features.reserve(input.size(rt));
+    for(size_t i = 0; i < input.size(rt); i++) {
+      mapbox::feature::feature<double> feature;
+      parseJSIFeature(rt, i, feature, input.getValueAtIndex(rt, i),
+                      numericProperties);
+      features.push_back(std::move(feature));
+    }
+    pendingFeaturesInput.emplace(rt, std::move(input));
+  } else {
+    size_t length = 0;
+    auto data = reinterpret_cast<const double *>(
+        typedArrayData(rt, args[0], "Float64Array", length));
+    if(length % 2 != 0)
+      throw jsi::JSError(rt,
+                         "React-Native-Clusterer: loadAsync expects "
+                         "longitude / latitude pairs");
+    lngLat.assign(data, data + length);
+
+    if(count == 3 && !args[2].isUndefined()) {
+      size_t idsLength = 0;
+      auto idsData = reinterpret_cast<const std::uint32_t *>(
+          typedArrayData(rt, args[2], "Uint32Array", idsLength));
+      if(idsLength != length / 2)
+        throw jsi::JSError(rt,
+                           "React-Native-Clusterer: loadAsync expects "
+                           "one id per point");
+      ids.assign(idsData, idsData + idsLength);
+    }
+    pendingFeaturesInput.emplace(rt, jsi::Array(rt, 0));
+  }
+
+  auto task = std::make_shared<LoadTask>();
+  pendingLoad = task;
+  options.cancelled = [cancelled = task->cancelled]() {
+    return cancelled->load();
+  };
+
+  auto promise = createPromise(
+      rt, [this](jsi::Function &&resolve, jsi::Function &&reject) {
+        pendingResolve.emplace(std::move(resolve));
+        pendingReject.emplace(std::move(reject));
+      });
+
+  // the build runs off the JS thread, the previous index keeps answering
+  // queries until the new one is swapped in on the JS thread
+  auto dispatcher = Dispatcher::getRuntimeGlobalDispatcher(rt);
+  std::weak_ptr<HybridObject> weakSelf = weak_from_this();
+  jsi::Runtime *runtime = &rt;
+  std::thread([task, weakSelf, dispatcher, runtime, coordinates,
+               features = std::move(features), lngLat = std::move(lngLat),
+               ids = std::move(ids), options]() mutable {
+    try {
+      if(coordinates)
+        task->index = std::make_unique<mapbox::supercluster::Supercluster>(
+            lngLat.data(), lngLat.size() / 2,
+            ids.empty() ? nullptr : ids.data(), options);
+      else
+        task->index = std::make_unique<mapbox::supercluster::Supercluster>(
+            features, options);
+    } catch(mapbox::supercluster::BuildCancelled &) {
+      return;
+    } catch(std::exception &e) {
+      task->error = e.what();
+    }
+    if(*task->cancelled) return;
+
+    dispatcher->runAsync([task, weakSelf, runtime]() {
+      auto self =
+          std::dynamic_pointer_cast<HybridClusterer>(weakSelf.lock());
+      if(self) self->finishLoad(*runtime, task);
+    });
+  }).detach();
+
+  return promise;
+}
+
+void HybridClusterer::cancelPendingLoad(jsi::Runtime &rt) {
+  if(!pendingLoad) return;
+  *pendingLoad->cancelled = true;
+  pendingLoad.reset();
+  pendingFeaturesInput.reset();
+  pendingResolve.reset();
+  if(pendingReject) {
+    auto reject = std::move(*pendingReject);
+    pendingReject.reset();
+    reject.call(rt, createError(rt,
+                                "React-Native-Clusterer: load superseded by a "
+                                "newer load"));
+  }
+}
+
+void HybridClusterer::finishLoad(jsi::Runtime &rt,
+                                 const std::shared_ptr<LoadTask> &task) {
+  // a newer load took over while this one was finishing
+  if(task != pendingLoad) return;
+  pendingLoad.reset();
+  auto resolve = std::move(*pendingResolve);
+  auto reject = std::move(*pendingReject);
+  pendingResolve.reset();
+  pendingReject.reset();
+
+  if(!task->index) {
+    pendingFeaturesInput.reset();
+    std::string message =
+        std::string("React-Native-Clusterer: Error creating Supercluser") +
+        task->error;
+    reject.call(rt, createError(rt, message));
+    return;
+  }
+
+  if(instance) delete instance.value();
+  instance = task->index.release();
+  featuresInput = std::move(pendingFeaturesInput);
+  pendingFeaturesInput.reset();
+  visibleClusters.clear();
+  resolve.call(rt);
+}
+
+jsi::Value HybridClusterer::serialize(jsi::Runtime &rt, const jsi::Value &_,
+                                      const jsi::Value *args, size_t count) {
+  return bytesToArrayBuffer(rt, instance.value()->serialize());
+}
+
+jsi::Value HybridClusterer::deserialize(jsi::Runtime &rt, const jsi::Value &_,
+                                        const jsi::Value *args, size_t count) {
+  if(count < 2 || count > 3)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: deserialize "
+                       "expects 2 or 3 arguments");
+
+  mapbox::supercluster::Options options;
+  parseJSIOptions(rt, options, args[1]);
+  cancelPendingLoad(rt);
+
+  // a snapshot given as a file path is mapped natively, not read through JS
+  std::unique_ptr<mapbox::supercluster::Supercluster> index;
+  try {
+    if(args[0].isString()) {
+      index = mapbox::supercluster::Supercluster::mapSnapshot(
+          args[0].asString(rt).utf8(rt), options);
+    } else if(args[0].isObject() && args[0].asObject(rt).isArrayBuffer(rt)) {
+      auto buffer = args[0].asObject(rt).getArrayBuffer(rt);
+      index = mapbox::supercluster::Supercluster::deserialize(
+          reinterpret_cast<const char *>(buffer.data(rt)), buffer.size(rt),
+          options);
+    } else
+      throw jsi::JSError(rt,
+                         "React-Native-Clusterer: deserialize expects an "
+                         "ArrayBuffer or a file path");
+  } catch(std::logic_error &e) {
+    std::string message = std::string("React-Native-Clusterer: ") + e.what();
+    throw jsi::JSError(rt, message.c_str());
+  } catch(std::runtime_error &e) {
+    std::string message = std::string("React-Native-Clusterer: ") + e.what();
+    throw jsi::JSError(rt, message.c_str());
+  }
+
+  // points of an index loaded from features take their properties from them
+  size_t numFeatures = index->features.size();
+  if(count == 3 && args[2].isObject() && args[2].asObject(rt).isArray(rt)) {
+    auto input = args[2].asObject(rt).asArray(rt);
+    if(input.size(rt) != numFeatures)
+      throw jsi::JSError(rt,
+                         "React-Native-Clusterer: deserialize expects the "
+                         "features the snapshot was built from");
+    featuresInput.emplace(rt, std::move(input));
+  } else if(numFeatures == 0) {
+    featuresInput.emplace(rt, jsi::Array(rt, 0));
+  } else
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: deserialize expects the "
+                       "features the snapshot was built from");
+
+  if(instance) delete instance.value();
+  instance = index.release();
+  visibleClusters.clear();
+  return jsi::Value();
+}
+
+jsi::Value HybridClusterer::insert(jsi::Runtime &rt, const jsi::Value &_,
+                                   const jsi::Value *args, size_t count) {
+  if(count < 1 || count > 2)
+    throw jsi::JSError(
+        rt, "React-Native-Clusterer: insert expects 1 or 2 arguments");
+  auto &index = *instance.value();
+
+  try {
+    if(args[0].isObject() && args[0].asObject(rt).isArray(rt)) {
+      const auto numericProperties = aggregatedProperties(index.options);
+      auto input = args[0].asObject(rt).asArray(rt);
+      mapbox::feature::feature_collection<double> features;
+      features.reserve(input.size(rt));
+      for(size_t i = 0; i < input.size(rt); i++) {
+        mapbox::feature::feature<double> feature;
+        parseJSIFeature(rt, featuresInput->size() + i, feature,
+                        input.getValueAtIndex(rt, i), numericProperties);
+        features.push_back(std::move(feature));
+      }
+      index.insert(features);
+      featuresInput->append(rt, std::move(input));
+    } else {
+      size_t length = 0;
+      auto lngLat = reinterpret_cast<const double *>(
+          typedArrayData(rt, args[0], "Float64Array", length));
+      if(length % 2 != 0)
+        throw jsi::JSError(rt,
+                           "React-Native-Clusterer: insert expects "
+                           "longitude / latitude pairs");
+
+      const std::uint32_t *ids = nullptr;
+      if(count == 2 && !args[1].isUndefined()) {
+        size_t idsLength = 0;
+        ids = reinterpret_cast<const std::uint32_t *>(
+            typedArrayData(rt, args[1], "Uint32Array", idsLength));
+        if(idsLength != length / 2)
+          throw jsi::JSError(rt,
+                             "React-Native-Clusterer: insert expects "
+                             "one id per point");
+      }
+      index.insert(lngLat, length / 2, ids);
+    }
+  } catch(std::logic_error &e) {
+    std::string message = std::string("React-Native-Clusterer: ") + e.what();
+    throw jsi::JSError(rt, message.c_str());
+  }
+
+  return jsi::Value();
+}
+
+// Point and cluster ids are 32 bit integers, other numbers name no point or
+// cluster
+static bool toId(const jsi::Value &value, std::uint32_t &id) {
+  auto number = value.asNumber();
+  if(!(number >= 0 && number <= std::numeric_limits<std::uint32_t>::max()) ||
+     number != std::floor(number))
+    return false;
+  id = (std::uint32_t)number;
+  return true;
+}
+
+jsi::Value HybridClusterer::remove(jsi::Runtime &rt, const jsi::Value &_,
+                                   const jsi::Value *args, size_t count) {
+  if(count != 1 || !args[0].isObject())
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: remove expects an array or "
+                       "Uint32Array of ids");
+
+  std::vector<std::uint32_t> ids;
+  auto object = args[0].asObject(rt);
+  if(object.isArray(rt)) {
+    auto array = object.asArray(rt);
+    ids.reserve(array.size(rt));
+    for(size_t i = 0; i < array.size(rt); i++) {
+      std::uint32_t id;
+      if(toId(array.getValueAtIndex(rt, i), id)) ids.push_back(id);
+    }
+  } else {
+    size_t length = 0;
+    auto data = reinterpret_cast<const std::uint32_t *>(
+        typedArrayData(rt, args[0], "Uint32Array", length));
+    ids.assign(data, data + length);
+  }
+
+  auto removed = instance.value()->remove(ids.data(), ids.size());
+  return jsi::Value((double)removed);
+}
+
+jsi::Value HybridClusterer::updatePositions(jsi::Runtime &rt,
+                                            const jsi::Value &_,
+                                            const jsi::Value *args,
+                                            size_t count) {
+  if(count != 2)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: updatePositions expects ids "
+                       "and longitude / latitude pairs");
+
+  size_t idsLength = 0;
+  auto ids = reinterpret_cast<const std::uint32_t *>(
+      typedArrayData(rt, args[0], "Uint32Array", idsLength));
+  size_t length = 0;
+  auto lngLat = reinterpret_cast<const double *>(
+      typedArrayData(rt, args[1], "Float64Array", length));
+  if(length != 2 * idsLength)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: updatePositions expects one "
+                       "longitude / latitude pair per id");
+
+  auto moved = instance.value()->updatePositions(ids, lngLat, idsLength);
+  return jsi::Value((double)moved);
+}
+
+JSIStrings &HybridClusterer::jsiStrings(jsi::Runtime &rt) {
+  if(!strings || strings->runtime != &rt) strings.emplace(rt);
+  return *strings;
+}
+
 jsi::Value HybridClusterer::getClusters(jsi::Runtime &rt,
                                         const jsi::Value &thisValue,
                                         const jsi::Value *args, size_t count) {
@@ -46,34 +422,124 @@ jsi::Value HybridClusterer::getClusters(jsi::Runtime &rt,
                        "expects an array and a number");
 
   double bbox[4];
-
-  try {
-    auto jsibbox = args[0].asObject(rt).asArray(rt);
-    bbox[0] = jsibbox.getValueAtIndex(rt, 0).asNumber();
-    bbox[1] = jsibbox.getValueAtIndex(rt, 1).asNumber();
-    bbox[2] = jsibbox.getValueAtIndex(rt, 2).asNumber();
-    bbox[3] = jsibbox.getValueAtIndex(rt, 3).asNumber();
-  } catch(exception &e) {
-    throw jsi::JSError(rt,
-                       "React-Native-Clusterer: GetClusters error, make sure "
-                       "boundingBox is an array of 4 numbers");
-  }
+  parseJSIBBox(rt, bbox, args[0]);
 
   int zoom = (int)args[1].asNumber();
 
   auto clusters = instance.value()->getClusters(bbox, zoom);
   jsi::Array result = jsi::Array(rt, clusters.size());
+  auto &strings = jsiStrings(rt);
 
   int i = 0;
   for(auto &cluster : clusters) {
     jsi::Object jsiCluster = jsi::Object(rt);
-    clusterToJSI(rt, jsiCluster, cluster, featuresInput.value());
+    clusterToJSI(rt, jsiCluster, cluster, featuresInput.value(), strings);
     result.setValueAtIndex(rt, i, jsiCluster);
     i++;
   }
   return result;
 }
 
+jsi::Value HybridClusterer::getClustersColumnar(jsi::Runtime &rt,
+                                                const jsi::Value &thisValue,
+                                                const jsi::Value *args,
+                                                size_t count) {
+  if(count < 2 || count > 3 || !args[0].asObject(rt).isArray(rt) ||
+     !args[1].isNumber())
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getClustersColumnar "
+                       "expects an array, a number and an optional object");
+
+  double bbox[4];
+  parseJSIBBox(rt, bbox, args[0]);
+  int zoom = (int)args[1].asNumber();
+
+  clusterColumns.clear();
+  auto clusterer = instance.value();
+  clusterer->eachCluster(
+      bbox, zoom, [&](const mapbox::supercluster::Cluster &c) {
+        auto lngLat = clusterer->coordinates(c);
+        clusterColumns.push_back(lngLat.x, lngLat.y, c,
+                                 clusterer->expansionZoom(c));
+      });
+
+  // the typed arrays of a passed in result are reused
+  jsi::Object result = count == 3 && args[2].isObject()
+                           ? args[2].asObject(rt)
+                           : jsi::Object(rt);
+  columnsToJSI(rt, result, clusterColumns);
+  return result;
+}
+
+jsi::Value HybridClusterer::getTileColumnar(jsi::Runtime &rt,
+                                            const jsi::Value &thisValue,
+                                            const jsi::Value *args,
+                                            size_t count) {
+  if(count < 3 || count > 4 || !args[0].isNumber() || !args[1].isNumber() ||
+     !args[2].isNumber())
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getTileColumnar "
+                       "expects 3 numbers and an optional object");
+
+  int zoom = (int)args[0].asNumber();
+  int x = (int)args[1].asNumber();
+  int y = (int)args[2].asNumber();
+
+  tileColumns.clear();
+  auto clusterer = instance.value();
+  clusterer->eachTileCluster(
+      zoom, x, y,
+      [&](const mapbox::supercluster::Cluster &c,
+          const mapbox::geometry::point<std::int16_t> &point) {
+        tileColumns.push_back(point.x, point.y, c, clusterer->expansionZoom(c));
+      });
+
+  jsi::Object result = count == 4 && args[3].isObject()
+                           ? args[3].asObject(rt)
+                           : jsi::Object(rt);
+  columnsToJSI(rt, result, tileColumns);
+  return result;
+}
+
+jsi::Value HybridClusterer::diffClusters(jsi::Runtime &rt,
+                                         const jsi::Value &thisValue,
+                                         const jsi::Value *args,
+                                         size_t count) {
+  if(count != 2 || !args[0].asObject(rt).isArray(rt) || !args[1].isNumber())
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: diffClusters "
+                       "expects an array and a number");
+
+  double bbox[4];
+  parseJSIBBox(rt, bbox, args[0]);
+  int zoom = (int)args[1].asNumber();
+
+  auto diff = instance.value()->diffClusters(bbox, zoom, visibleClusters);
+  auto &strings = jsiStrings(rt);
+
+  jsi::Array added = jsi::Array(rt, diff.added.size());
+  jsi::Array addedKeys = jsi::Array(rt, diff.added.size());
+  for(size_t i = 0; i < diff.added.size(); i++) {
+    jsi::Object jsiCluster = jsi::Object(rt);
+    clusterToJSI(rt, jsiCluster, diff.added[i], featuresInput.value(),
+                 strings);
+    added.setValueAtIndex(rt, i, jsiCluster);
+    addedKeys.setValueAtIndex(rt, i, (double)diff.addedKeys[i]);
+  }
+
+  jsi::Array removed = jsi::Array(rt, diff.removed.size());
+  for(size_t i = 0; i < diff.removed.size(); i++) {
+    removed.setValueAtIndex(rt, i, (double)diff.removed[i]);
+  }
+
+  jsi::Object result = jsi::Object(rt);
+  result.setProperty(rt, "added", added);
+  result.setProperty(rt, "addedKeys", addedKeys);
+  result.setProperty(rt, "removed", removed);
+  result.setProperty(rt, "unchangedCount", (double)diff.unchanged);
+  return result;
+}
+
 jsi::Value HybridClusterer::getTile(jsi::Runtime &rt,
                                         const jsi::Value &thisValue,
                                         const jsi::Value *args, size_t count) {
@@ -87,19 +553,61 @@ jsi::Value HybridClusterer::getTile(jsi::Runtime &rt,
            int x = (int)args[1].asNumber();
            int y = (int)args[2].asNumber();
 
-           auto tiles = instance.value()->getTile(zoom, x, y);
+           auto tiles = instance.value()->getSharedTile(zoom, x, y);
 
-           jsi::Array result = jsi::Array(rt, tiles.size());
+           jsi::Array result = jsi::Array(rt, tiles->size());
+           auto &strings = jsiStrings(rt);
            int i = 0;
-           for(auto &tile : tiles) {
+           for(auto &tile : *tiles) {
              jsi::Object jsiTile = jsi::Object(rt);
-             tileToJSI(rt, jsiTile, tile, featuresInput.value());
+             tileToJSI(rt, jsiTile, tile, featuresInput.value(), strings);
              result.setValueAtIndex(rt, i, jsiTile);
              i++;
            }
            return result;
 }
 
+jsi::Value HybridClusterer::getVectorTile(jsi::Runtime &rt,
+                                          const jsi::Value &thisValue,
+                                          const jsi::Value *args,
+                                          size_t count) {
+  if(count < 3 || count > 4 || !args[0].isNumber() || !args[1].isNumber() ||
+     !args[2].isNumber())
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getVectorTile "
+                       "expects 3 numbers and an optional layer name");
+
+  int zoom = (int)args[0].asNumber();
+  int x = (int)args[1].asNumber();
+  int y = (int)args[2].asNumber();
+  std::string layerName = count == 4 && args[3].isString()
+                              ? args[3].asString(rt).utf8(rt)
+                              : "clusters";
+
+  auto clusterer = instance.value();
+  auto tile = clusterer->getTile(zoom, x, y);
+  for(auto &feature : tile) {
+    originalPropertiesToNative(rt, feature.properties, featuresInput.value());
+  }
+
+  return bytesToArrayBuffer(
+      rt, encodeVectorTile(tile, layerName, clusterer->options.extent));
+}
+
+jsi::Value HybridClusterer::getTileCacheStats(jsi::Runtime &rt,
+                                              const jsi::Value &thisValue,
+                                              const jsi::Value *args,
+                                              size_t count) {
+  auto stats = instance.value()->tileCacheStats();
+
+  jsi::Object result = jsi::Object(rt);
+  result.setProperty(rt, "hits", (double)stats.hits);
+  result.setProperty(rt, "misses", (double)stats.misses);
+  result.setProperty(rt, "tiles", (double)stats.tiles);
+  result.setProperty(rt, "bytes", (double)stats.bytes);
+  return result;
+}
+
 jsi::Value HybridClusterer::getChildren(jsi::Runtime &rt,
                                         const jsi::Value &thisValue,
                                         const jsi::Value *args, size_t count) {
@@ -108,14 +616,21 @@ jsi::Value HybridClusterer::getChildren(jsi::Runtime &rt,
                        "React-Native-Clusterer: getChildren "
                        "expects a number for cluster_id");
 
-  auto cluster_id = (int)args[0].asNumber();
-  auto children = instance.value()->getChildren(cluster_id);
-  jsi::Array result = jsi::Array(rt, children.size());
+  std::uint32_t cluster_id = 0;
+  std::optional<mapbox::feature::feature_collection<double>> children;
+  if(toId(args[0], cluster_id))
+    children = instance.value()->tryGetChildren(cluster_id);
+  if(!children)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getChildren "
+                       "no cluster with the specified id");
+  jsi::Array result = jsi::Array(rt, children->size());
+  auto &strings = jsiStrings(rt);
 
   int i = 0;
-  for(auto &child : children) {
+  for(auto &child : *children) {
     jsi::Object jsiChild = jsi::Object(rt);
-    clusterToJSI(rt, jsiChild, child, featuresInput.value());
+    clusterToJSI(rt, jsiChild, child, featuresInput.value(), strings);
     result.setValueAtIndex(rt, i, jsiChild);
     i++;
   }
@@ -145,17 +660,24 @@ jsi::Value HybridClusterer::getLeaves(jsi::Runtime &rt,
                        "React-Native-Clusterer: getLeaves "
                        "third argument must be a number");
 
-  auto cluster_id = (int)args[0].asNumber();
   auto limit = count >= 2 ? (int)args[1].asNumber() : 10;
   auto offset = count == 3 ? (int)args[2].asNumber() : 0;
 
-  auto leaves = instance.value()->getLeaves(cluster_id, limit, offset);
-  jsi::Array result = jsi::Array(rt, leaves.size());
+  std::uint32_t cluster_id = 0;
+  std::optional<mapbox::feature::feature_collection<double>> leaves;
+  if(toId(args[0], cluster_id))
+    leaves = instance.value()->tryGetLeaves(cluster_id, limit, offset);
+  if(!leaves)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getLeaves "
+                       "no cluster with the specified id");
+  jsi::Array result = jsi::Array(rt, leaves->size());
+  auto &strings = jsiStrings(rt);
 
   int i = 0;
-  for(auto &leaf : leaves) {
+  for(auto &leaf : *leaves) {
     jsi::Object jsiLeaf = jsi::Object(rt);
-    clusterToJSI(rt, jsiLeaf, leaf, featuresInput.value());
+    clusterToJSI(rt, jsiLeaf, leaf, featuresInput.value(), strings);
     result.setValueAtIndex(rt, i, jsiLeaf);
     i++;
   }
@@ -173,9 +695,88 @@ jsi::Value HybridClusterer::getClusterExpansionZoom(jsi::Runtime &rt,
         "React-Native-Clusterer: getClusterExpansionZoom expects "
         "number for cluster_id");
 
-  auto cluster_id = (int)args[0].asNumber();
+  std::uint32_t cluster_id = 0;
+  std::optional<std::uint8_t> zoom;
+  if(toId(args[0], cluster_id))
+    zoom = instance.value()->tryGetClusterExpansionZoom(cluster_id);
+  if(!zoom)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getClusterExpansionZoom "
+                       "no cluster with the specified id");
+
+  return (int)*zoom;
+}
+
+jsi::Value HybridClusterer::hasCluster(jsi::Runtime &rt,
+                                       const jsi::Value &thisValue,
+                                       const jsi::Value *args, size_t count) {
+  if(count != 1 || !args[0].isNumber())
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: hasCluster expects "
+                       "number for cluster_id");
+
+  std::uint32_t cluster_id = 0;
+  return toId(args[0], cluster_id) &&
+         instance.value()->hasCluster(cluster_id);
+}
+
+jsi::Value HybridClusterer::getClusterBounds(jsi::Runtime &rt,
+                                             const jsi::Value &thisValue,
+                                             const jsi::Value *args,
+                                             size_t count) {
+  if(count != 1 || !args[0].isNumber())
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getClusterBounds expects "
+                       "number for cluster_id");
+
+  std::uint32_t cluster_id = 0;
+  if(!toId(args[0], cluster_id) ||
+     !instance.value()->hasCluster(cluster_id))
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getClusterBounds "
+                       "no cluster with the specified id");
+  auto bounds = instance.value()->getClusterBounds(cluster_id);
+  jsi::Array result = jsi::Array(rt, bounds.size());
+  for(size_t i = 0; i < bounds.size(); i++)
+    result.setValueAtIndex(rt, i, bounds[i]);
+  return result;
+}
+
+jsi::Value HybridClusterer::getClustersBounds(jsi::Runtime &rt,
+                                              const jsi::Value &thisValue,
+                                              const jsi::Value *args,
+                                              size_t count) {
+  if(count < 1 || count > 2 || !args[0].isObject())
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getClustersBounds expects "
+                       "columns and an optional Float64Array");
+
+  auto columns = args[0].asObject(rt);
+  auto length = (size_t)columns.getProperty(rt, "length").asNumber();
+  size_t idsLength = 0, isClusterLength = 0;
+  auto ids = reinterpret_cast<const std::uint32_t *>(typedArrayData(
+      rt, columns.getProperty(rt, "id"), "Uint32Array", idsLength));
+  auto isCluster = typedArrayData(rt, columns.getProperty(rt, "isCluster"),
+                                  "Uint8Array", isClusterLength);
+  if(idsLength < length || isClusterLength < length)
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: getClustersBounds expects "
+                       "length ids and isCluster flags");
+
+  // a passed in array is reused when it is large enough
+  jsi::Value out = count == 2 ? jsi::Value(rt, args[1]) : jsi::Value();
+  size_t capacity = 0;
+  if(!out.isUndefined())
+    typedArrayData(rt, out, "Float64Array", capacity);
+  if(out.isUndefined() || capacity < 4 * length)
+    out = rt.global()
+              .getPropertyAsFunction(rt, "Float64Array")
+              .callAsConstructor(rt, (double)(4 * length));
+  auto bounds = reinterpret_cast<double *>(
+      typedArrayData(rt, out, "Float64Array", capacity));
 
-  return (int)instance.value()->getClusterExpansionZoom(cluster_id);
+  instance.value()->getClustersBounds(ids, isCluster, length, bounds);
+  return out;
 }
 
 }  // namespace margelo::nitro::clusterer
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include "HybridClustererSpec.hpp"
+#include "jsiHelpers.hpp"
 #include "supercluster.hpp"
 
 namespace margelo::nitro::clusterer {
@@ -8,18 +12,45 @@ class HybridClusterer final : public HybridClustererSpec {
  public:
   HybridClusterer() : HybridObject(TAG) {}
   ~HybridClusterer() {
-    auto instancePtr = instance.value();
-    delete instancePtr;
+    // a build still running has no clusterer to swap its index into
+    if(pendingLoad) *pendingLoad->cancelled = true;
+    // no index when the first load failed or never finished
+    if(instance) delete *instance;
   }
 
  public:
   jsi::Value load(jsi::Runtime &runtime, const jsi::Value &thisValue,
                   const jsi::Value *args, size_t count);
+  jsi::Value loadCoordinates(jsi::Runtime &rt, const jsi::Value &thisValue,
+                             const jsi::Value *args, size_t count);
+  jsi::Value loadAsync(jsi::Runtime &rt, const jsi::Value &thisValue,
+                       const jsi::Value *args, size_t count);
+  jsi::Value serialize(jsi::Runtime &rt, const jsi::Value &thisValue,
+                       const jsi::Value *args, size_t count);
+  jsi::Value deserialize(jsi::Runtime &rt, const jsi::Value &thisValue,
+                         const jsi::Value *args, size_t count);
+  jsi::Value insert(jsi::Runtime &rt, const jsi::Value &thisValue,
+                    const jsi::Value *args, size_t count);
+  jsi::Value remove(jsi::Runtime &rt, const jsi::Value &thisValue,
+                    const jsi::Value *args, size_t count);
+  jsi::Value updatePositions(jsi::Runtime &rt, const jsi::Value &thisValue,
+                             const jsi::Value *args, size_t count);
   jsi::Value getClusters(jsi::Runtime &runtime, const jsi::Value &thisValue,
                          const jsi::Value *args, size_t count);
+  jsi::Value diffClusters(jsi::Runtime &rt, const jsi::Value &thisValue,
+                          const jsi::Value *args, size_t count);
+  jsi::Value getClustersColumnar(jsi::Runtime &rt,
+                                 const jsi::Value &thisValue,
+                                 const jsi::Value *args, size_t count);
+  jsi::Value getTileColumnar(jsi::Runtime &rt, const jsi::Value &thisValue,
+                             const jsi::Value *args, size_t count);
   jsi::Value getTile(jsi::Runtime &rt,
                                           const jsi::Value &thisValue,
                      const jsi::Value *args, size_t count);
+  jsi::Value getVectorTile(jsi::Runtime &rt, const jsi::Value &thisValue,
+                           const jsi::Value *args, size_t count);
+  jsi::Value getTileCacheStats(jsi::Runtime &rt, const jsi::Value &thisValue,
+                               const jsi::Value *args, size_t count);
   jsi::Value getChildren(jsi::Runtime &rt,
                                           const jsi::Value &thisValue,
                                           const jsi::Value *args, size_t count);
@@ -30,6 +61,12 @@ class HybridClusterer final : public HybridClustererSpec {
   jsi::Value getClusterExpansionZoom(
       jsi::Runtime &rt, const jsi::Value &thisValue, const jsi::Value *args,
       size_t count);
+  jsi::Value hasCluster(jsi::Runtime &rt, const jsi::Value &thisValue,
+                        const jsi::Value *args, size_t count);
+  jsi::Value getClusterBounds(jsi::Runtime &rt, const jsi::Value &thisValue,
+                              const jsi::Value *args, size_t count);
+  jsi::Value getClustersBounds(jsi::Runtime &rt, const jsi::Value &thisValue,
+                               const jsi::Value *args, size_t count);
 
   void loadHybridMethods() override {
     // register base prototype
@@ -37,22 +74,74 @@ class HybridClusterer final : public HybridClustererSpec {
     // register all methods we override here
     registerHybrids(this, [](Prototype &prototype) {
       prototype.registerRawHybridMethod("load", 0, &HybridClusterer::load);
+      prototype.registerRawHybridMethod("loadCoordinates", 0,
+                                        &HybridClusterer::loadCoordinates);
+      prototype.registerRawHybridMethod("loadAsync", 0,
+                                        &HybridClusterer::loadAsync);
+      prototype.registerRawHybridMethod("serialize", 0,
+                                        &HybridClusterer::serialize);
+      prototype.registerRawHybridMethod("deserialize", 0,
+                                        &HybridClusterer::deserialize);
+      prototype.registerRawHybridMethod("insert", 0, &HybridClusterer::insert);
+      prototype.registerRawHybridMethod("remove", 0, &HybridClusterer::remove);
+      prototype.registerRawHybridMethod("updatePositions", 0,
+                                        &HybridClusterer::updatePositions);
       prototype.registerRawHybridMethod("getClusters", 0,
                                         &HybridClusterer::getClusters);
       prototype.registerRawHybridMethod("getTile", 0,
                                         &HybridClusterer::getTile);
+      prototype.registerRawHybridMethod("diffClusters", 0,
+                                        &HybridClusterer::diffClusters);
+      prototype.registerRawHybridMethod("getClustersColumnar", 0,
+                                        &HybridClusterer::getClustersColumnar);
+      prototype.registerRawHybridMethod("getTileColumnar", 0,
+                                        &HybridClusterer::getTileColumnar);
+      prototype.registerRawHybridMethod("getVectorTile", 0,
+                                        &HybridClusterer::getVectorTile);
+      prototype.registerRawHybridMethod("getTileCacheStats", 0,
+                                        &HybridClusterer::getTileCacheStats);
       prototype.registerRawHybridMethod("getChildren", 0,
                                         &HybridClusterer::getChildren);
       prototype.registerRawHybridMethod("getLeaves", 0,
                                         &HybridClusterer::getLeaves);
       prototype.registerRawHybridMethod("getClusterExpansionZoom", 0,
                                         &HybridClusterer::getClusterExpansionZoom);
+      prototype.registerRawHybridMethod("hasCluster", 0,
+                                        &HybridClusterer::hasCluster);
+      prototype.registerRawHybridMethod("getClusterBounds", 0,
+                                        &HybridClusterer::getClusterBounds);
+      prototype.registerRawHybridMethod("getClustersBounds", 0,
+                                        &HybridClusterer::getClustersBounds);
     });
   }
 
  private:
   std::optional<mapbox::supercluster::Supercluster *> instance = std::nullopt;
-  std::optional<jsi::Array> featuresInput = std::nullopt;
+  std::optional<JSIFeatures> featuresInput = std::nullopt;
+  Columns<double> clusterColumns;
+  Columns<std::int16_t> tileColumns;
+  // clusters returned by the last diffClusters call
+  std::vector<mapbox::supercluster::Supercluster::VisibleCluster>
+      visibleClusters;
+  std::optional<JSIStrings> strings = std::nullopt;
+
+  // index built by loadAsync on a worker thread, handed back to the JS
+  // thread once done. The flag is shared with the options of the index, which
+  // keep polling it while building and would keep the task alive otherwise
+  struct LoadTask {
+    std::shared_ptr<std::atomic<bool>> cancelled =
+        std::make_shared<std::atomic<bool>>(false);
+    std::unique_ptr<mapbox::supercluster::Supercluster> index;
+    std::string error;
+  };
+  std::shared_ptr<LoadTask> pendingLoad;
+  std::optional<JSIFeatures> pendingFeaturesInput = std::nullopt;
+  std::optional<jsi::Function> pendingResolve = std::nullopt;
+  std::optional<jsi::Function> pendingReject = std::nullopt;
+
+  JSIStrings &jsiStrings(jsi::Runtime &rt);
+  void cancelPendingLoad(jsi::Runtime &rt);
+  void finishLoad(jsi::Runtime &rt, const std::shared_ptr<LoadTask> &task);
 };
 
 }  // namespace margelo::nitro::clusterer
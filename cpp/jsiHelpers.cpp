@@ -1,5 +1,7 @@
 #include "jsiHelpers.hpp"
 
+#include <cstring>
+
 namespace margelo::nitro::clusterer {
 
 void parseJSIOptions(jsi::Runtime &rt, mapbox::supercluster::Options &options,
@@ -45,6 +47,49 @@ void parseJSIOptions(jsi::Runtime &rt, mapbox::supercluster::Options &options,
       } else
         throw jsi::JSError(rt, "Expected number for minPoints");
     }
+    if(obj.hasProperty(rt, "threads")) {
+      jsi::Value threads = obj.getProperty(rt, "threads");
+      if(threads.isNumber() && threads.asNumber() >= 0) {
+        options.threads = (size_t)threads.asNumber();
+      } else
+        throw jsi::JSError(rt, "Expected non-negative number for threads");
+    }
+    if(obj.hasProperty(rt, "tileCacheSize")) {
+      jsi::Value size = obj.getProperty(rt, "tileCacheSize");
+      if(size.isNumber() && size.asNumber() >= 0) {
+        options.tileCacheSize = (size_t)size.asNumber();
+      } else
+        throw jsi::JSError(rt,
+                           "Expected non-negative number for tileCacheSize");
+    }
+    if(obj.hasProperty(rt, "lazyZooms")) {
+      jsi::Value lazyZooms = obj.getProperty(rt, "lazyZooms");
+      if(lazyZooms.isBool()) {
+        options.lazyZooms = lazyZooms.getBool();
+      } else
+        throw jsi::JSError(rt, "Expected boolean for lazyZooms");
+    }
+    if(obj.hasProperty(rt, "indexPrecision")) {
+      jsi::Value precision = obj.getProperty(rt, "indexPrecision");
+      std::string name =
+          precision.isString() ? precision.asString(rt).utf8(rt) : "";
+      if(name == "double") {
+        options.precision = mapbox::supercluster::IndexPrecision::Double;
+      } else if(name == "float") {
+        options.precision = mapbox::supercluster::IndexPrecision::Float;
+      } else if(name == "quantized") {
+        options.precision = mapbox::supercluster::IndexPrecision::Quantized;
+      } else
+        throw jsi::JSError(
+            rt,
+            "Expected 'double', 'float' or 'quantized' for indexPrecision");
+    }
+    if(obj.hasProperty(rt, "reduce")) {
+      jsi::Value reduce = obj.getProperty(rt, "reduce");
+      if(!reduce.isObject())
+        throw jsi::JSError(rt, "Expected object for reduce");
+      parseJSIReduce(rt, options.aggregates, reduce.asObject(rt));
+    }
     if(obj.hasProperty(rt, "generateId")) {
       jsi::Value generateId = obj.getProperty(rt, "generateId");
       if(generateId.isBool()) {
@@ -56,9 +101,61 @@ void parseJSIOptions(jsi::Runtime &rt, mapbox::supercluster::Options &options,
     throw jsi::JSError(rt, "Expected object for options");
 };
 
+static mapbox::supercluster::Aggregate::Op parseJSIReduceOp(
+    jsi::Runtime &rt, jsi::Value const &value) {
+  using Op = mapbox::supercluster::Aggregate::Op;
+  std::string name = value.isString() ? value.asString(rt).utf8(rt) : "";
+  if(name == "sum") return Op::Sum;
+  if(name == "min") return Op::Min;
+  if(name == "max") return Op::Max;
+  if(name == "count") return Op::Count;
+  if(name == "mean") return Op::Mean;
+  throw jsi::JSError(
+      rt, "Expected 'sum', 'min', 'max', 'count' or 'mean' in reduce");
+}
+
+void parseJSIReduce(jsi::Runtime &rt,
+                    std::vector<mapbox::supercluster::Aggregate> &aggregates,
+                    jsi::Object const &jsiReduce) {
+  jsi::Array names = jsiReduce.getPropertyNames(rt);
+  for(size_t i = 0; i < names.size(rt); i++) {
+    mapbox::supercluster::Aggregate aggregate;
+    aggregate.name = names.getValueAtIndex(rt, i).asString(rt).utf8(rt);
+    jsi::Value spec = jsiReduce.getProperty(rt, aggregate.name.c_str());
+
+    // 'op' reads the property of the same name, ['op', 'property'] another one
+    if(spec.isObject() && spec.asObject(rt).isArray(rt)) {
+      jsi::Array pair = spec.asObject(rt).asArray(rt);
+      if(pair.size(rt) != 2 || !pair.getValueAtIndex(rt, 1).isString())
+        throw jsi::JSError(rt, "Expected [operator, property] in reduce");
+      aggregate.op = parseJSIReduceOp(rt, pair.getValueAtIndex(rt, 0));
+      aggregate.property = pair.getValueAtIndex(rt, 1).asString(rt).utf8(rt);
+    } else {
+      aggregate.op = parseJSIReduceOp(rt, spec);
+      // a plain 'count' counts the points
+      if(aggregate.op != mapbox::supercluster::Aggregate::Op::Count)
+        aggregate.property = aggregate.name;
+    }
+    aggregates.push_back(std::move(aggregate));
+  }
+}
+
+std::vector<std::string> aggregatedProperties(
+    const mapbox::supercluster::Options &options) {
+  std::vector<std::string> properties;
+  for(auto &aggregate : options.aggregates) {
+    if(!aggregate.property.empty() &&
+       std::find(properties.begin(), properties.end(), aggregate.property) ==
+           properties.end())
+      properties.push_back(aggregate.property);
+  }
+  return properties;
+}
+
 void parseJSIFeature(jsi::Runtime &rt, int featureIndex,
                      mapbox::feature::feature<double> &feature,
-                     jsi::Value const &jsiFeature) {
+                     jsi::Value const &jsiFeature,
+                     const std::vector<std::string> &numericProperties) {
   if(!jsiFeature.isObject())
     throw jsi::JSError(rt, "Expected GeoJSON Feature object");
 
@@ -106,18 +203,147 @@ void parseJSIFeature(jsi::Runtime &rt, int featureIndex,
   feature.geometry = point;
 
   feature.properties["_clusterer_index"] = std::uint64_t(featureIndex);
+
+  // only the properties read by the native reduce operators are copied
+  if(numericProperties.empty() || !obj.hasProperty(rt, "properties")) return;
+  jsi::Value properties = obj.getProperty(rt, "properties");
+  if(!properties.isObject()) return;
+  jsi::Object propertiesObj = properties.asObject(rt);
+  for(auto &name : numericProperties) {
+    jsi::Value value = propertiesObj.getProperty(rt, name.c_str());
+    if(value.isNumber()) feature.properties[name] = value.asNumber();
+  }
 };
 
+void parseJSIBBox(jsi::Runtime &rt, double bbox[4], jsi::Value const &jsiBBox) {
+  try {
+    auto jsibbox = jsiBBox.asObject(rt).asArray(rt);
+    bbox[0] = jsibbox.getValueAtIndex(rt, 0).asNumber();
+    bbox[1] = jsibbox.getValueAtIndex(rt, 1).asNumber();
+    bbox[2] = jsibbox.getValueAtIndex(rt, 2).asNumber();
+    bbox[3] = jsibbox.getValueAtIndex(rt, 3).asNumber();
+  } catch(exception &e) {
+    throw jsi::JSError(rt,
+                       "React-Native-Clusterer: GetClusters error, make sure "
+                       "boundingBox is an array of 4 numbers");
+  }
+}
+
+uint8_t *typedArrayData(jsi::Runtime &rt, jsi::Value const &value,
+                        const char *type, size_t &length) {
+  std::string message = std::string("Expected ") + type;
+  if(!value.isObject()) throw jsi::JSError(rt, message);
+
+  jsi::Object obj = value.asObject(rt);
+  jsi::Value constructor = obj.getProperty(rt, "constructor");
+  if(!constructor.isObject() ||
+     constructor.asObject(rt).getProperty(rt, "name").toString(rt).utf8(rt) !=
+         type)
+    throw jsi::JSError(rt, message);
+
+  jsi::Value buffer = obj.getProperty(rt, "buffer");
+  if(!buffer.isObject() || !buffer.asObject(rt).isArrayBuffer(rt))
+    throw jsi::JSError(rt, message);
+
+  auto byteOffset = (size_t)obj.getProperty(rt, "byteOffset").asNumber();
+  length = (size_t)obj.getProperty(rt, "length").asNumber();
+  return buffer.asObject(rt).getArrayBuffer(rt).data(rt) + byteOffset;
+}
+
+template <typename T>
+static void columnToJSI(jsi::Runtime &rt, jsi::Object &out, const char *name,
+                        const char *type, const std::vector<T> &column) {
+  jsi::Value array = out.getProperty(rt, name);
+  size_t capacity = 0;
+  if(!array.isUndefined()) typedArrayData(rt, array, type, capacity);
+  if(array.isUndefined() || capacity < column.size()) {
+    // headroom, so a growing viewport does not reallocate on every query
+    auto size = std::max(column.size() + column.size() / 2, (size_t)64);
+    array = rt.global().getPropertyAsFunction(rt, type).callAsConstructor(
+        rt, (double)size);
+    out.setProperty(rt, name, array);
+  }
+  auto data = typedArrayData(rt, array, type, capacity);
+  if(!column.empty())
+    std::memcpy(data, column.data(), column.size() * sizeof(T));
+}
+
+template <typename TCoord>
+static void writeColumns(jsi::Runtime &rt, jsi::Object &out,
+                         const Columns<TCoord> &columns, const char *xName,
+                         const char *yName, const char *coordType) {
+  columnToJSI(rt, out, xName, coordType, columns.x);
+  columnToJSI(rt, out, yName, coordType, columns.y);
+  columnToJSI(rt, out, "pointCount", "Uint32Array", columns.pointCount);
+  columnToJSI(rt, out, "id", "Uint32Array", columns.id);
+  columnToJSI(rt, out, "isCluster", "Uint8Array", columns.isCluster);
+  columnToJSI(rt, out, "expansionZoom", "Uint8Array", columns.expansionZoom);
+  out.setProperty(rt, "length", (double)columns.x.size());
+}
+
+void columnsToJSI(jsi::Runtime &rt, jsi::Object &out,
+                  const Columns<double> &columns) {
+  writeColumns(rt, out, columns, "lng", "lat", "Float64Array");
+}
+
+void columnsToJSI(jsi::Runtime &rt, jsi::Object &out,
+                  const Columns<std::int16_t> &columns) {
+  writeColumns(rt, out, columns, "x", "y", "Int16Array");
+}
+
+JSIStrings::JSIStrings(jsi::Runtime &rt)
+    : runtime(&rt),
+      id(jsi::PropNameID::forAscii(rt, "id")),
+      type(jsi::PropNameID::forAscii(rt, "type")),
+      geometry(jsi::PropNameID::forAscii(rt, "geometry")),
+      coordinates(jsi::PropNameID::forAscii(rt, "coordinates")),
+      properties(jsi::PropNameID::forAscii(rt, "properties")),
+      tags(jsi::PropNameID::forAscii(rt, "tags")),
+      feature(jsi::String::createFromAscii(rt, "Feature")),
+      point(jsi::String::createFromAscii(rt, "Point")) {}
+
+const jsi::PropNameID &JSIStrings::key(jsi::Runtime &rt,
+                                       const std::string &name) {
+  auto itr = keys.find(name);
+  if(itr == keys.end())
+    itr = keys.emplace(name, jsi::PropNameID::forUtf8(rt, name)).first;
+  return itr->second;
+}
+
+JSIFeatures::JSIFeatures(jsi::Runtime &rt, jsi::Array &&features) {
+  append(rt, std::move(features));
+}
+
+void JSIFeatures::append(jsi::Runtime &rt, jsi::Array &&features) {
+  ends.push_back((ends.empty() ? 0 : ends.back()) + features.size(rt));
+  arrays.push_back(std::move(features));
+}
+
+jsi::Value JSIFeatures::getValueAtIndex(jsi::Runtime &rt, size_t index) const {
+  if(arrays.size() == 1) return arrays[0].getValueAtIndex(rt, index);
+  auto array = std::upper_bound(ends.begin(), ends.end(), index) - ends.begin();
+  return arrays[array].getValueAtIndex(
+      rt, index - (array == 0 ? 0 : ends[array - 1]));
+}
+
+// index of the JS feature a point was loaded from, -1 for clusters
+static int originalFeatureIndex(const mapbox::feature::property_map &p) {
+  auto itr = p.find("_clusterer_index");
+  if(itr == p.end()) return -1;
+  return (int)itr->second.get<std::uint64_t>();
+}
+
 void clusterToJSI(jsi::Runtime &rt, jsi::Object &jsiObject,
                   mapbox::feature::feature<double> &f,
-                  jsi::Array &featuresInput) {
+                  JSIFeatures &featuresInput, JSIStrings &strings) {
   // .id
   if(f.id.is<uint64_t>()) {
-    jsiObject.setProperty(rt, "id", jsi::Value((int)f.id.get<uint64_t>()));
+    jsiObject.setProperty(rt, strings.id,
+                          jsi::Value((int)f.id.get<uint64_t>()));
   }
 
   //  .type
-  jsiObject.setProperty(rt, "type", jsi::String::createFromUtf8(rt, "Feature"));
+  jsiObject.setProperty(rt, strings.type, jsi::Value(rt, strings.feature));
 
   // .geometry - differs from tile geometry
   jsi::Object geometry = jsi::Object(rt);
@@ -125,39 +351,40 @@ void clusterToJSI(jsi::Runtime &rt, jsi::Object &jsiObject,
   auto geo = f.geometry.get<mapbox::geometry::point<double>>();
   coordinates.setValueAtIndex(rt, 0, jsi::Value(geo.x));
   coordinates.setValueAtIndex(rt, 1, jsi::Value(geo.y));
-  geometry.setProperty(rt, "type", jsi::String::createFromUtf8(rt, "Point"));
-  geometry.setProperty(rt, "coordinates", coordinates);
-  jsiObject.setProperty(rt, "geometry", geometry);
-
-  // .properties
-  jsi::Object properties = jsi::Object(rt);
-  int origFeatureIndex = -1;
-  for(auto &itr : f.properties) {
-    featurePropertyToJSI(rt, properties, itr, origFeatureIndex);
-  }
+  geometry.setProperty(rt, strings.type, jsi::Value(rt, strings.point));
+  geometry.setProperty(rt, strings.coordinates, coordinates);
+  jsiObject.setProperty(rt, strings.geometry, geometry);
 
+  // .properties, points take them from their JS feature
+  int origFeatureIndex = originalFeatureIndex(f.properties);
   if(origFeatureIndex != -1) {
     jsi::Object originalFeature =
         featuresInput.getValueAtIndex(rt, origFeatureIndex).asObject(rt);
-    if(originalFeature.hasProperty(rt, "properties")) {
-      jsiObject.setProperty(rt, "properties",
-                            originalFeature.getProperty(rt, "properties"));
+    if(originalFeature.hasProperty(rt, strings.properties)) {
+      jsiObject.setProperty(
+          rt, strings.properties,
+          originalFeature.getProperty(rt, strings.properties));
     }
   } else {
-    jsiObject.setProperty(rt, "properties", properties);
+    jsi::Object properties = jsi::Object(rt);
+    for(auto &itr : f.properties) {
+      featurePropertyToJSI(rt, properties, itr, origFeatureIndex, strings);
+    }
+    jsiObject.setProperty(rt, strings.properties, properties);
   }
 }
 
 void tileToJSI(jsi::Runtime &rt, jsi::Object &jsiObject,
-               mapbox::feature::feature<std::int16_t> &f,
-               jsi::Array &featuresInput) {
+               const mapbox::feature::feature<std::int16_t> &f,
+               JSIFeatures &featuresInput, JSIStrings &strings) {
   // .id
   if(f.id.is<uint64_t>()) {
-    jsiObject.setProperty(rt, "id", jsi::Value((int)f.id.get<uint64_t>()));
+    jsiObject.setProperty(rt, strings.id,
+                          jsi::Value((int)f.id.get<uint64_t>()));
   }
 
   // .type
-  jsiObject.setProperty(rt, "type", 1);
+  jsiObject.setProperty(rt, strings.type, 1);
 
   // .geometry
   jsi::Array geometryContainer = jsi::Array(rt, 1);
@@ -166,40 +393,109 @@ void tileToJSI(jsi::Runtime &rt, jsi::Object &jsiObject,
   geometry.setValueAtIndex(rt, 0, jsi::Value((int)geo.x));
   geometry.setValueAtIndex(rt, 1, jsi::Value((int)geo.y));
   geometryContainer.setValueAtIndex(rt, 0, geometry);
-  jsiObject.setProperty(rt, "geometry", geometryContainer);
+  jsiObject.setProperty(rt, strings.geometry, geometryContainer);
 
   // .tags
-  jsi::Object tags = jsi::Object(rt);
-  int origFeatureIndex = -1;
-  for(auto &itr : f.properties) {
-    featurePropertyToJSI(rt, tags, itr, origFeatureIndex);
-  }
-
+  int origFeatureIndex = originalFeatureIndex(f.properties);
   if(origFeatureIndex != -1) {
     jsi::Object originalFeature =
         featuresInput.getValueAtIndex(rt, origFeatureIndex).asObject(rt);
-    if(originalFeature.hasProperty(rt, "properties")) {
-      jsiObject.setProperty(rt, "tags",
-                            originalFeature.getProperty(rt, "properties"));
+    if(originalFeature.hasProperty(rt, strings.properties)) {
+      jsiObject.setProperty(
+          rt, strings.tags,
+          originalFeature.getProperty(rt, strings.properties));
     }
   } else {
-    jsiObject.setProperty(rt, "tags", tags);
+    jsi::Object tags = jsi::Object(rt);
+    for(auto &itr : f.properties) {
+      featurePropertyToJSI(rt, tags, itr, origFeatureIndex, strings);
+    }
+    jsiObject.setProperty(rt, strings.tags, tags);
   }
 }
 
+void originalPropertiesToNative(jsi::Runtime &rt,
+                                mapbox::feature::property_map &properties,
+                                JSIFeatures &featuresInput) {
+  int origFeatureIndex = originalFeatureIndex(properties);
+  if(origFeatureIndex == -1) return;
+  properties.clear();
+
+  jsi::Object originalFeature =
+      featuresInput.getValueAtIndex(rt, origFeatureIndex).asObject(rt);
+  if(!originalFeature.hasProperty(rt, "properties")) return;
+  jsi::Value originalProperties = originalFeature.getProperty(rt, "properties");
+  if(!originalProperties.isObject()) return;
+
+  jsi::Object obj = originalProperties.asObject(rt);
+  jsi::Array names = obj.getPropertyNames(rt);
+  for(size_t i = 0; i < names.size(rt); i++) {
+    auto name = names.getValueAtIndex(rt, i).asString(rt).utf8(rt);
+    jsi::Value value = obj.getProperty(rt, name.c_str());
+    if(value.isBool()) {
+      properties[name] = value.getBool();
+    } else if(value.isNumber()) {
+      properties[name] = value.asNumber();
+    } else if(value.isString()) {
+      properties[name] = value.asString(rt).utf8(rt);
+    }
+  }
+}
+
+jsi::Value createPromise(
+    jsi::Runtime &rt,
+    const std::function<void(jsi::Function &&resolve, jsi::Function &&reject)>
+        &executor) {
+  auto jsiExecutor = jsi::Function::createFromHostFunction(
+      rt, jsi::PropNameID::forAscii(rt, "executor"), 2,
+      [executor](jsi::Runtime &rt, const jsi::Value &_, const jsi::Value *args,
+                 size_t count) -> jsi::Value {
+        executor(args[0].asObject(rt).asFunction(rt),
+                 args[1].asObject(rt).asFunction(rt));
+        return jsi::Value::undefined();
+      });
+  return rt.global().getPropertyAsFunction(rt, "Promise").callAsConstructor(
+      rt, jsiExecutor);
+}
+
+jsi::Value createError(jsi::Runtime &rt, const std::string &message) {
+  return rt.global().getPropertyAsFunction(rt, "Error").callAsConstructor(
+      rt, jsi::String::createFromUtf8(rt, message));
+}
+
+namespace {
+class BytesBuffer : public jsi::MutableBuffer {
+ public:
+  explicit BytesBuffer(std::string &&bytes) : bytes_(std::move(bytes)) {}
+  size_t size() const override { return bytes_.size(); }
+  uint8_t *data() override {
+    return reinterpret_cast<uint8_t *>(bytes_.data());
+  }
+
+ private:
+  std::string bytes_;
+};
+}  // namespace
+
+jsi::ArrayBuffer bytesToArrayBuffer(jsi::Runtime &rt, std::string &&bytes) {
+  return jsi::ArrayBuffer(rt, std::make_shared<BytesBuffer>(std::move(bytes)));
+}
+
 void featurePropertyToJSI(
     jsi::Runtime &rt, jsi::Object &jsiFeatureProperties,
-    std::pair<const std::string, mapbox::feature::value> &itr,
-    int &origFeatureIndex) {
-  auto name = itr.first;
-  auto nameJSI = jsi::String::createFromUtf8(rt, name);
+    const std::pair<const std::string, mapbox::feature::value> &itr,
+    int &origFeatureIndex, JSIStrings &strings) {
+  auto &name = itr.first;
   auto type = itr.second.which();
 
   if(name == "_clusterer_index") {
     origFeatureIndex = (int)itr.second.get<std::uint64_t>();
+    return;
   }
+
+  auto &nameJSI = strings.key(rt, name);
   // Boolean
-  else if(type == 1) {
+  if(type == 1) {
     jsiFeatureProperties.setProperty(rt, nameJSI,
                                      jsi::Value(itr.second.get<bool>() == 1));
   }
@@ -3,6 +3,7 @@
 #include <jsi/jsi.h>
 
 #include <map>
+#include <unordered_map>
 
 #include "supercluster.hpp"
 
@@ -14,21 +15,138 @@ namespace margelo::nitro::clusterer {
 void parseJSIOptions(jsi::Runtime &rt, mapbox::supercluster::Options &options,
                      jsi::Value const &jsiOptions);
 
+void parseJSIReduce(jsi::Runtime &rt,
+                    std::vector<mapbox::supercluster::Aggregate> &aggregates,
+                    jsi::Object const &jsiReduce);
+
+// Point properties that have to be copied to the native features for
+// options.aggregates
+std::vector<std::string> aggregatedProperties(
+    const mapbox::supercluster::Options &options);
+
+void parseJSIBBox(jsi::Runtime &rt, double bbox[4], jsi::Value const &jsiBBox);
+
 void parseJSIFeature(jsi::Runtime &rt, int featureIndex,
                      mapbox::feature::feature<double> &feature,
-                     jsi::Value const &jsiFeature);
+                     jsi::Value const &jsiFeature,
+                     const std::vector<std::string> &numericProperties);
+
+// Elements of a JS typed array with the given constructor name (e.g.
+// "Float64Array"), in place in its ArrayBuffer
+uint8_t *typedArrayData(jsi::Runtime &rt, jsi::Value const &value,
+                        const char *type, size_t &length);
+
+// Columnar getClusters / getTile results, see ClusterColumns in types.ts. x and
+// y are the coordinates (longitude / latitude or tile coordinates), id is the
+// cluster id of clusters and the load index of points, expansionZoom that of
+// getClusterExpansionZoom for clusters and 0 for points. Kept by HybridClusterer
+// so steady-state queries reuse the capacity.
+template <typename TCoord>
+struct Columns {
+  std::vector<TCoord> x;
+  std::vector<TCoord> y;
+  std::vector<uint32_t> pointCount;
+  std::vector<uint32_t> id;
+  std::vector<uint8_t> isCluster;
+  std::vector<uint8_t> expansionZoom;
+
+  void clear() {
+    x.clear();
+    y.clear();
+    pointCount.clear();
+    id.clear();
+    isCluster.clear();
+    expansionZoom.clear();
+  }
+
+  void push_back(TCoord x_, TCoord y_, const mapbox::supercluster::Cluster &c,
+                 uint8_t expansionZoom_) {
+    x.push_back(x_);
+    y.push_back(y_);
+    pointCount.push_back(c.num_points);
+    id.push_back(c.id);
+    isCluster.push_back(c.num_points > 1);
+    expansionZoom.push_back(expansionZoom_);
+  }
+};
+
+// Copies columns into the typed arrays of out ({ lng, lat, ... } for
+// clusters, { x, y, ... } for tiles), replacing only arrays that are too small
+void columnsToJSI(jsi::Runtime &rt, jsi::Object &out,
+                  const Columns<double> &columns);
+void columnsToJSI(jsi::Runtime &rt, jsi::Object &out,
+                  const Columns<std::int16_t> &columns);
+
+// Property names and strings used by the serializers below, created once per
+// runtime instead of for every feature of every query
+struct JSIStrings {
+  explicit JSIStrings(jsi::Runtime &rt);
+
+  jsi::Runtime *runtime;
+  jsi::PropNameID id;
+  jsi::PropNameID type;
+  jsi::PropNameID geometry;
+  jsi::PropNameID coordinates;
+  jsi::PropNameID properties;
+  jsi::PropNameID tags;
+  jsi::String feature;
+  jsi::String point;
+
+  // Property keys (cluster, cluster_id, point_count, reduce outputs, ...),
+  // interned on first use
+  const jsi::PropNameID &key(jsi::Runtime &rt, const std::string &name);
+
+ private:
+  std::unordered_map<std::string, jsi::PropNameID> keys;
+};
+
+// JS features of the points by point index: the array passed to load,
+// followed by the arrays passed to insert
+class JSIFeatures {
+ public:
+  JSIFeatures(jsi::Runtime &rt, jsi::Array &&features);
+
+  void append(jsi::Runtime &rt, jsi::Array &&features);
+  size_t size() const { return ends.back(); }
+  jsi::Value getValueAtIndex(jsi::Runtime &rt, size_t index) const;
+
+ private:
+  std::vector<jsi::Array> arrays;
+  // point index after the last feature of each array
+  std::vector<size_t> ends;
+};
 
 void clusterToJSI(jsi::Runtime &rt, jsi::Object &jsiObject,
                   mapbox::feature::feature<double> &f,
-                  jsi::Array &featuresInput);
+                  JSIFeatures &featuresInput, JSIStrings &strings);
 
 void tileToJSI(jsi::Runtime &rt, jsi::Object &jsiObject,
-               mapbox::feature::feature<std::int16_t> &f,
-               jsi::Array &featuresInput);
+               const mapbox::feature::feature<std::int16_t> &f,
+               JSIFeatures &featuresInput, JSIStrings &strings);
+
+// Replaces the properties of a point loaded by load(), which only hold the
+// index of its JS feature, with the boolean, number and string properties of
+// that feature
+void originalPropertiesToNative(jsi::Runtime &rt,
+                                mapbox::feature::property_map &properties,
+                                JSIFeatures &featuresInput);
+
+// new Promise(executor), the executor is called synchronously with the resolve
+// and reject functions
+jsi::Value createPromise(
+    jsi::Runtime &rt,
+    const std::function<void(jsi::Function &&resolve, jsi::Function &&reject)>
+        &executor);
+
+// new Error(message)
+jsi::Value createError(jsi::Runtime &rt, const std::string &message);
+
+// ArrayBuffer taking ownership of bytes
+jsi::ArrayBuffer bytesToArrayBuffer(jsi::Runtime &rt, std::string &&bytes);
 
 void featurePropertyToJSI(jsi::Runtime &rt,
                    jsi::Object &jsiFeatureProperties,
-                   std::pair<const std::string, mapbox::feature::value> &itr,
-                   int &origFeatureIndex);
+                   const std::pair<const std::string, mapbox::feature::value> &itr,
+                   int &origFeatureIndex, JSIStrings &strings);
 
 }  // namespace clusterer
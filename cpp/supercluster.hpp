@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <iomanip>
 #include <memory>
@@ -11,6 +12,8 @@
 #include <unordered_map>
 #include <cassert>
 #include <cstddef>   // size_t
+#include <cstring>   // memcpy
+#include <fstream>
 #include <new>       // operator new
 #include <stdexcept> // runtime_error
 #include <tuple>
@@ -18,6 +21,43 @@
 #include <typeinfo>
 #include <utility>
 #include <functional>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <limits>
+#include <iterator>
+#include <system_error>
+#include <bit>
+#include <variant>
+#include <optional>
+#include <list>
+#include <mutex>
+#include <set>
+#include <map>
+#include <unordered_set>
+
+// Vectorized KD-tree leaf scans, define KDBUSH_NO_SIMD to use the scalar loops only.
+#if !defined(KDBUSH_NO_SIMD)
+#if defined(__AVX__)
+#include <immintrin.h>
+#define KDBUSH_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define KDBUSH_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define KDBUSH_NEON
+#endif
+#endif
+
+// Supercluster::mapSnapshot maps snapshot files where mmap is available
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SUPERCLUSTER_MMAP
+#endif
 
 #ifdef DEBUG_TIMER
 #include <chrono>
@@ -1556,40 +1596,38 @@ namespace mapbox
         using namespace mapbox::geometry;
         using namespace mapbox::feature;
 
+        // Query-time cluster record. State only needed while the next zoom level is built lives
+        // in temporary buffers, and map / reduce properties are stored next to the clusters of a
+        // level (see Supercluster::Zoom), so every record is 32 bytes.
         class Cluster
         {
         public:
-            const point<double> pos;
-            const std::uint32_t num_points;
+            point<double> pos;
+            std::uint32_t num_points; // 0 once removed by an update, see Supercluster::insert
             std::uint32_t id;
             std::uint32_t parent_id = 0;
-            bool visited = false;
-            std::unique_ptr<property_map> properties{nullptr};
+            // zoom at which the cluster splits, recorded by the build (0 if unknown, see
+            // Supercluster::getClusterExpansionZoom); fits in what was padding
+            std::uint8_t expansion_zoom = 0;
+
+            Cluster() = default;
 
             Cluster(const point<double> &pos_, const std::uint32_t num_points_, const std::uint32_t id_)
                 : pos(pos_), num_points(num_points_), id(id_)
             {
             }
 
-            Cluster(const point<double> &pos_,
-                    const std::uint32_t num_points_,
-                    const std::uint32_t id_,
-                    const property_map &properties_)
-                : pos(pos_), num_points(num_points_), id(id_)
+            mapbox::feature::feature<double> toGeoJSON() const
             {
-                if (!properties_.empty())
-                {
-                    properties = std::make_unique<property_map>(properties_);
-                }
+                return {lngLat(), getProperties(), identifier(static_cast<std::uint64_t>(id))};
             }
 
-            mapbox::feature::feature<double> toGeoJSON() const
+            point<double> lngLat() const
             {
                 const double x = (pos.x - 0.5) * 360.0;
                 const double y =
                     360.0 * std::atan(std::exp((180.0 - pos.y * 360.0) * M_PI / 180)) / M_PI - 90.0;
-                return {point<double>{x, y}, getProperties(),
-                        identifier(static_cast<std::uint64_t>(id))};
+                return {x, y};
             }
 
             property_map getProperties() const
@@ -1612,13 +1650,6 @@ namespace mapbox
                     ss << num_points;
                 }
                 result.emplace("point_count_abbreviated", ss.str());
-                if (properties)
-                {
-                    for (const auto &property : *properties)
-                    {
-                        result.emplace(property);
-                    }
-                }
                 return result;
             }
         };
@@ -1637,599 +1668,4283 @@ namespace kdbush
         }
     };
 
-    template <typename TPoint, typename TIndex = std::size_t>
-    class KDBush
+    namespace detail
     {
+        // Calls visitor(id) and tells whether the traversal should go on: visitors may return
+        // false to stop it, visitors returning void always continue.
+        template <typename TVisitor, typename TItem>
+        inline bool visitContinue(const TVisitor &visitor, const TItem &item)
+        {
+            if constexpr (std::is_void<decltype(visitor(item))>::value)
+            {
+                visitor(item);
+                return true;
+            }
+            else
+            {
+                return visitor(item);
+            }
+        }
 
-    public:
-        using TNumber = decltype(nth<0, TPoint>::get(std::declval<TPoint>()));
-        static_assert(
-            std::is_same<TNumber, decltype(nth<1, TPoint>::get(std::declval<TPoint>()))>::value,
-            "point component types must be identical");
-
-        static const std::uint8_t defaultNodeSize = 64;
+        // Leaf kernels: call visit(i), in ascending order, for every i in [begin, end) whose
+        // coordinate passes the bbox or squared distance test, until visit returns false (the
+        // kernel then returns false as well). The double and float overloads
+        // test 4 / 8 (AVX), 2 / 4 (SSE2, NEON) points per instruction, everything else uses
+        // the scalar loop.
 
-        KDBush(const std::uint8_t nodeSize_ = defaultNodeSize) : nodeSize(nodeSize_)
+        template <typename TCoord, typename TCompare, typename TVisit>
+        inline bool scanRange(const TCoord *xs, const TCoord *ys, std::size_t begin, const std::size_t end,
+                              const TCompare minX, const TCompare minY, const TCompare maxX, const TCompare maxY,
+                              const TVisit &visit)
         {
+            for (; begin < end; begin++)
+            {
+                const TCompare x = xs[begin];
+                const TCompare y = ys[begin];
+                if (x >= minX && x <= maxX && y >= minY && y <= maxY)
+                    if (!visit(begin))
+                        return false;
+            }
+            return true;
         }
 
-        KDBush(const std::vector<TPoint> &points_, const std::uint8_t nodeSize_ = defaultNodeSize)
-            : KDBush(std::begin(points_), std::end(points_), nodeSize_)
+        template <typename TCoord, typename TCompare, typename TVisit>
+        inline bool scanWithin(const TCoord *xs, const TCoord *ys, std::size_t begin, const std::size_t end,
+                               const TCompare qx, const TCompare qy, const TCompare r2, const TVisit &visit)
         {
+            for (; begin < end; begin++)
+            {
+                const TCompare dx = xs[begin] - qx;
+                const TCompare dy = ys[begin] - qy;
+                if (dx * dx + dy * dy <= r2)
+                    if (!visit(begin))
+                        return false;
+            }
+            return true;
         }
 
-        template <typename TPointIter>
-        KDBush(const TPointIter &points_begin,
-               const TPointIter &points_end,
-               const std::uint8_t nodeSize_ = defaultNodeSize)
-            : nodeSize(nodeSize_)
+        template <typename TVisit>
+        inline bool visitMask(std::uint32_t mask, const std::size_t offset, const TVisit &visit)
         {
-            fill(points_begin, points_end);
+            while (mask)
+            {
+                if (!visit(offset + static_cast<std::size_t>(std::countr_zero(mask))))
+                    return false;
+                mask &= mask - 1;
+            }
+            return true;
         }
 
-        void fill(const std::vector<TPoint> &points_)
+#if defined(KDBUSH_AVX)
+        template <typename TVisit>
+        inline bool scanRange(const double *xs, const double *ys, std::size_t begin, const std::size_t end,
+                              const double minX, const double minY, const double maxX, const double maxY,
+                              const TVisit &visit)
         {
-            fill(std::begin(points_), std::end(points_));
+            const __m256d vMinX = _mm256_set1_pd(minX);
+            const __m256d vMinY = _mm256_set1_pd(minY);
+            const __m256d vMaxX = _mm256_set1_pd(maxX);
+            const __m256d vMaxY = _mm256_set1_pd(maxY);
+            for (; begin + 4 <= end; begin += 4)
+            {
+                const __m256d x = _mm256_loadu_pd(xs + begin);
+                const __m256d y = _mm256_loadu_pd(ys + begin);
+                const __m256d inX = _mm256_and_pd(_mm256_cmp_pd(x, vMinX, _CMP_GE_OQ), _mm256_cmp_pd(x, vMaxX, _CMP_LE_OQ));
+                const __m256d inY = _mm256_and_pd(_mm256_cmp_pd(y, vMinY, _CMP_GE_OQ), _mm256_cmp_pd(y, vMaxY, _CMP_LE_OQ));
+                if (!visitMask(static_cast<std::uint32_t>(_mm256_movemask_pd(_mm256_and_pd(inX, inY))), begin, visit))
+                    return false;
+            }
+            return scanRange<double>(xs, ys, begin, end, minX, minY, maxX, maxY, visit);
         }
 
-        template <typename TPointIter>
-        void fill(const TPointIter &points_begin, const TPointIter &points_end)
+        template <typename TVisit>
+        inline bool scanWithin(const double *xs, const double *ys, std::size_t begin, const std::size_t end,
+                               const double qx, const double qy, const double r2, const TVisit &visit)
         {
-            assert(points.empty());
-            const TIndex size = static_cast<TIndex>(std::distance(points_begin, points_end));
-
-            if (size == 0)
-                return;
+            const __m256d vQx = _mm256_set1_pd(qx);
+            const __m256d vQy = _mm256_set1_pd(qy);
+            const __m256d vR2 = _mm256_set1_pd(r2);
+            for (; begin + 4 <= end; begin += 4)
+            {
+                const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + begin), vQx);
+                const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + begin), vQy);
+                const __m256d d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+                if (!visitMask(static_cast<std::uint32_t>(_mm256_movemask_pd(_mm256_cmp_pd(d2, vR2, _CMP_LE_OQ))), begin, visit))
+                    return false;
+            }
+            return scanWithin<double>(xs, ys, begin, end, qx, qy, r2, visit);
+        }
+        template <typename TVisit>
+        inline bool scanRange(const float *xs, const float *ys, std::size_t begin, const std::size_t end,
+                              const float minX, const float minY, const float maxX, const float maxY,
+                              const TVisit &visit)
+        {
+            const __m256 vMinX = _mm256_set1_ps(minX);
+            const __m256 vMinY = _mm256_set1_ps(minY);
+            const __m256 vMaxX = _mm256_set1_ps(maxX);
+            const __m256 vMaxY = _mm256_set1_ps(maxY);
+            for (; begin + 8 <= end; begin += 8)
+            {
+                const __m256 x = _mm256_loadu_ps(xs + begin);
+                const __m256 y = _mm256_loadu_ps(ys + begin);
+                const __m256 inX = _mm256_and_ps(_mm256_cmp_ps(x, vMinX, _CMP_GE_OQ), _mm256_cmp_ps(x, vMaxX, _CMP_LE_OQ));
+                const __m256 inY = _mm256_and_ps(_mm256_cmp_ps(y, vMinY, _CMP_GE_OQ), _mm256_cmp_ps(y, vMaxY, _CMP_LE_OQ));
+                if (!visitMask(static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_and_ps(inX, inY))), begin, visit))
+                    return false;
+            }
+            return scanRange<float>(xs, ys, begin, end, minX, minY, maxX, maxY, visit);
+        }
 
-            points.reserve(size);
-            ids.reserve(size);
+        template <typename TVisit>
+        inline bool scanWithin(const float *xs, const float *ys, std::size_t begin, const std::size_t end,
+                               const float qx, const float qy, const float r2, const TVisit &visit)
+        {
+            const __m256 vQx = _mm256_set1_ps(qx);
+            const __m256 vQy = _mm256_set1_ps(qy);
+            const __m256 vR2 = _mm256_set1_ps(r2);
+            for (; begin + 8 <= end; begin += 8)
+            {
+                const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + begin), vQx);
+                const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(ys + begin), vQy);
+                const __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+                if (!visitMask(static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(d2, vR2, _CMP_LE_OQ))), begin, visit))
+                    return false;
+            }
+            return scanWithin<float>(xs, ys, begin, end, qx, qy, r2, visit);
+        }
+#elif defined(KDBUSH_SSE2)
+        template <typename TVisit>
+        inline bool scanRange(const double *xs, const double *ys, std::size_t begin, const std::size_t end,
+                              const double minX, const double minY, const double maxX, const double maxY,
+                              const TVisit &visit)
+        {
+            const __m128d vMinX = _mm_set1_pd(minX);
+            const __m128d vMinY = _mm_set1_pd(minY);
+            const __m128d vMaxX = _mm_set1_pd(maxX);
+            const __m128d vMaxY = _mm_set1_pd(maxY);
+            for (; begin + 2 <= end; begin += 2)
+            {
+                const __m128d x = _mm_loadu_pd(xs + begin);
+                const __m128d y = _mm_loadu_pd(ys + begin);
+                const __m128d inX = _mm_and_pd(_mm_cmpge_pd(x, vMinX), _mm_cmple_pd(x, vMaxX));
+                const __m128d inY = _mm_and_pd(_mm_cmpge_pd(y, vMinY), _mm_cmple_pd(y, vMaxY));
+                if (!visitMask(static_cast<std::uint32_t>(_mm_movemask_pd(_mm_and_pd(inX, inY))), begin, visit))
+                    return false;
+            }
+            return scanRange<double>(xs, ys, begin, end, minX, minY, maxX, maxY, visit);
+        }
 
-            TIndex i = 0;
-            for (auto p = points_begin; p != points_end; p++)
+        template <typename TVisit>
+        inline bool scanWithin(const double *xs, const double *ys, std::size_t begin, const std::size_t end,
+                               const double qx, const double qy, const double r2, const TVisit &visit)
+        {
+            const __m128d vQx = _mm_set1_pd(qx);
+            const __m128d vQy = _mm_set1_pd(qy);
+            const __m128d vR2 = _mm_set1_pd(r2);
+            for (; begin + 2 <= end; begin += 2)
             {
-                points.emplace_back(nth<0, TPoint>::get(*p), nth<1, TPoint>::get(*p));
-                ids.push_back(i++);
+                const __m128d dx = _mm_sub_pd(_mm_loadu_pd(xs + begin), vQx);
+                const __m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + begin), vQy);
+                const __m128d d2 = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+                if (!visitMask(static_cast<std::uint32_t>(_mm_movemask_pd(_mm_cmple_pd(d2, vR2))), begin, visit))
+                    return false;
+            }
+            return scanWithin<double>(xs, ys, begin, end, qx, qy, r2, visit);
+        }
+        template <typename TVisit>
+        inline bool scanRange(const float *xs, const float *ys, std::size_t begin, const std::size_t end,
+                              const float minX, const float minY, const float maxX, const float maxY,
+                              const TVisit &visit)
+        {
+            const __m128 vMinX = _mm_set1_ps(minX);
+            const __m128 vMinY = _mm_set1_ps(minY);
+            const __m128 vMaxX = _mm_set1_ps(maxX);
+            const __m128 vMaxY = _mm_set1_ps(maxY);
+            for (; begin + 4 <= end; begin += 4)
+            {
+                const __m128 x = _mm_loadu_ps(xs + begin);
+                const __m128 y = _mm_loadu_ps(ys + begin);
+                const __m128 inX = _mm_and_ps(_mm_cmpge_ps(x, vMinX), _mm_cmple_ps(x, vMaxX));
+                const __m128 inY = _mm_and_ps(_mm_cmpge_ps(y, vMinY), _mm_cmple_ps(y, vMaxY));
+                if (!visitMask(static_cast<std::uint32_t>(_mm_movemask_ps(_mm_and_ps(inX, inY))), begin, visit))
+                    return false;
             }
+            return scanRange<float>(xs, ys, begin, end, minX, minY, maxX, maxY, visit);
+        }
 
-            sortKD(0, size - 1, 0);
+        template <typename TVisit>
+        inline bool scanWithin(const float *xs, const float *ys, std::size_t begin, const std::size_t end,
+                               const float qx, const float qy, const float r2, const TVisit &visit)
+        {
+            const __m128 vQx = _mm_set1_ps(qx);
+            const __m128 vQy = _mm_set1_ps(qy);
+            const __m128 vR2 = _mm_set1_ps(r2);
+            for (; begin + 4 <= end; begin += 4)
+            {
+                const __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + begin), vQx);
+                const __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + begin), vQy);
+                const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+                if (!visitMask(static_cast<std::uint32_t>(_mm_movemask_ps(_mm_cmple_ps(d2, vR2))), begin, visit))
+                    return false;
+            }
+            return scanWithin<float>(xs, ys, begin, end, qx, qy, r2, visit);
+        }
+#elif defined(KDBUSH_NEON)
+        inline std::uint32_t neonMask(const uint64x2_t m)
+        {
+            return static_cast<std::uint32_t>((vgetq_lane_u64(m, 0) & 1) | (vgetq_lane_u64(m, 1) & 2));
         }
 
-        template <typename TVisitor>
-        void range(const TNumber minX,
-                   const TNumber minY,
-                   const TNumber maxX,
-                   const TNumber maxY,
-                   const TVisitor &visitor) const
+        inline std::uint32_t neonMask(const uint32x4_t m)
         {
-            range(minX, minY, maxX, maxY, visitor, 0, static_cast<TIndex>(ids.size() - 1), 0);
+            const uint32x4_t bits = {1, 2, 4, 8};
+            return vaddvq_u32(vandq_u32(m, bits));
         }
 
-        template <typename TVisitor>
-        void within(const TNumber qx, const TNumber qy, const TNumber r, const TVisitor &visitor) const
+        template <typename TVisit>
+        inline bool scanRange(const double *xs, const double *ys, std::size_t begin, const std::size_t end,
+                              const double minX, const double minY, const double maxX, const double maxY,
+                              const TVisit &visit)
         {
-            within(qx, qy, r, visitor, 0, static_cast<TIndex>(ids.size() - 1), 0);
+            const float64x2_t vMinX = vdupq_n_f64(minX);
+            const float64x2_t vMinY = vdupq_n_f64(minY);
+            const float64x2_t vMaxX = vdupq_n_f64(maxX);
+            const float64x2_t vMaxY = vdupq_n_f64(maxY);
+            for (; begin + 2 <= end; begin += 2)
+            {
+                const float64x2_t x = vld1q_f64(xs + begin);
+                const float64x2_t y = vld1q_f64(ys + begin);
+                const uint64x2_t inX = vandq_u64(vcgeq_f64(x, vMinX), vcleq_f64(x, vMaxX));
+                const uint64x2_t inY = vandq_u64(vcgeq_f64(y, vMinY), vcleq_f64(y, vMaxY));
+                if (!visitMask(neonMask(vandq_u64(inX, inY)), begin, visit))
+                    return false;
+            }
+            return scanRange<double>(xs, ys, begin, end, minX, minY, maxX, maxY, visit);
         }
 
-    protected:
-        std::vector<TIndex> ids;
-        std::vector<std::pair<TNumber, TNumber>> points;
+        template <typename TVisit>
+        inline bool scanWithin(const double *xs, const double *ys, std::size_t begin, const std::size_t end,
+                               const double qx, const double qy, const double r2, const TVisit &visit)
+        {
+            const float64x2_t vQx = vdupq_n_f64(qx);
+            const float64x2_t vQy = vdupq_n_f64(qy);
+            const float64x2_t vR2 = vdupq_n_f64(r2);
+            for (; begin + 2 <= end; begin += 2)
+            {
+                const float64x2_t dx = vsubq_f64(vld1q_f64(xs + begin), vQx);
+                const float64x2_t dy = vsubq_f64(vld1q_f64(ys + begin), vQy);
+                const float64x2_t d2 = vaddq_f64(vmulq_f64(dx, dx), vmulq_f64(dy, dy));
+                if (!visitMask(neonMask(vcleq_f64(d2, vR2)), begin, visit))
+                    return false;
+            }
+            return scanWithin<double>(xs, ys, begin, end, qx, qy, r2, visit);
+        }
+        template <typename TVisit>
+        inline bool scanRange(const float *xs, const float *ys, std::size_t begin, const std::size_t end,
+                              const float minX, const float minY, const float maxX, const float maxY,
+                              const TVisit &visit)
+        {
+            const float32x4_t vMinX = vdupq_n_f32(minX);
+            const float32x4_t vMinY = vdupq_n_f32(minY);
+            const float32x4_t vMaxX = vdupq_n_f32(maxX);
+            const float32x4_t vMaxY = vdupq_n_f32(maxY);
+            for (; begin + 4 <= end; begin += 4)
+            {
+                const float32x4_t x = vld1q_f32(xs + begin);
+                const float32x4_t y = vld1q_f32(ys + begin);
+                const uint32x4_t inX = vandq_u32(vcgeq_f32(x, vMinX), vcleq_f32(x, vMaxX));
+                const uint32x4_t inY = vandq_u32(vcgeq_f32(y, vMinY), vcleq_f32(y, vMaxY));
+                if (!visitMask(neonMask(vandq_u32(inX, inY)), begin, visit))
+                    return false;
+            }
+            return scanRange<float>(xs, ys, begin, end, minX, minY, maxX, maxY, visit);
+        }
 
-    private:
-        const std::uint8_t nodeSize;
+        template <typename TVisit>
+        inline bool scanWithin(const float *xs, const float *ys, std::size_t begin, const std::size_t end,
+                               const float qx, const float qy, const float r2, const TVisit &visit)
+        {
+            const float32x4_t vQx = vdupq_n_f32(qx);
+            const float32x4_t vQy = vdupq_n_f32(qy);
+            const float32x4_t vR2 = vdupq_n_f32(r2);
+            for (; begin + 4 <= end; begin += 4)
+            {
+                const float32x4_t dx = vsubq_f32(vld1q_f32(xs + begin), vQx);
+                const float32x4_t dy = vsubq_f32(vld1q_f32(ys + begin), vQy);
+                const float32x4_t d2 = vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy));
+                if (!visitMask(neonMask(vcleq_f32(d2, vR2)), begin, visit))
+                    return false;
+            }
+            return scanWithin<float>(xs, ys, begin, end, qx, qy, r2, visit);
+        }
+#endif
+    } // namespace detail
 
-        template <typename TVisitor>
-        void range(const TNumber minX,
-                   const TNumber minY,
-                   const TNumber maxX,
-                   const TNumber maxY,
-                   const TVisitor &visitor,
-                   const TIndex left,
-                   const TIndex right,
-                   const std::uint8_t axis) const
+    namespace detail
+    {
+        // Contiguous items, either owned like a std::vector or borrowed from memory that
+        // outlives the array, such as a snapshot mapped with Supercluster::mapSnapshot. Borrowed
+        // items are read and written in place; changing their number copies them into an owned
+        // vector first.
+        template <typename T>
+        class Array
         {
+        public:
+            using value_type = T;
+            using size_type = std::size_t;
+            using iterator = T *;
+            using const_iterator = const T *;
+            using reference = T &;
+            using const_reference = const T &;
 
-            if (points.empty())
-                return;
+            Array() = default;
 
-            if (right - left <= nodeSize)
+            Array(std::vector<T> &&items_) : items(std::move(items_))
             {
-                for (auto i = left; i <= right; i++)
-                {
-                    const TNumber x = std::get<0>(points[i]);
-                    const TNumber y = std::get<1>(points[i]);
-                    if (x >= minX && x <= maxX && y >= minY && y <= maxY)
-                        visitor(ids[i]);
-                }
-                return;
+                sync();
             }
 
-            const TIndex m = (left + right) >> 1;
-            const TNumber x = std::get<0>(points[m]);
-            const TNumber y = std::get<1>(points[m]);
+            Array(Array &&other) noexcept
+                : items(std::move(other.items)), first(other.first), count(other.count), borrowed(other.borrowed)
+            {
+                other.reset();
+            }
 
-            if (x >= minX && x <= maxX && y >= minY && y <= maxY)
-                visitor(ids[m]);
+            Array &operator=(Array &&other) noexcept
+            {
+                items = std::move(other.items);
+                first = other.first;
+                count = other.count;
+                borrowed = other.borrowed;
+                other.reset();
+                return *this;
+            }
 
-            if (axis == 0 ? minX <= x : minY <= y)
-                range(minX, minY, maxX, maxY, visitor, left, m - 1, (axis + 1) % 2);
+            Array &operator=(std::vector<T> &&items_)
+            {
+                items = std::move(items_);
+                borrowed = false;
+                sync();
+                return *this;
+            }
 
-            if (axis == 0 ? maxX >= x : maxY >= y)
-                range(minX, minY, maxX, maxY, visitor, m + 1, right, (axis + 1) % 2);
-        }
+            Array(const Array &) = delete;
+            Array &operator=(const Array &) = delete;
 
-        template <typename TVisitor>
-        void within(const TNumber qx,
-                    const TNumber qy,
-                    const TNumber r,
-                    const TVisitor &visitor,
-                    const TIndex left,
-                    const TIndex right,
-                    const std::uint8_t axis) const
-        {
+            // size items at data, which must stay valid for the lifetime of the array
+            void borrow(T *data_, const std::size_t size_)
+            {
+                items = std::vector<T>();
+                first = data_;
+                count = size_;
+                borrowed = true;
+            }
 
-            if (points.empty())
-                return;
+            bool isBorrowed() const
+            {
+                return borrowed;
+            }
 
-            const TNumber r2 = r * r;
+            std::size_t size() const { return count; }
+            bool empty() const { return count == 0; }
+            // heap memory held, none for borrowed items
+            std::size_t capacity() const { return items.capacity(); }
+
+            T *data() { return first; }
+            const T *data() const { return first; }
+            T &operator[](const std::size_t i) { return first[i]; }
+            const T &operator[](const std::size_t i) const { return first[i]; }
+            T &back() { return first[count - 1]; }
+            const T &back() const { return first[count - 1]; }
+            T *begin() { return first; }
+            T *end() { return first + count; }
+            const T *begin() const { return first; }
+            const T *end() const { return first + count; }
+
+            void reserve(const std::size_t size_) { owned().reserve(size_); sync(); }
+            void resize(const std::size_t size_) { owned().resize(size_); sync(); }
+            void resize(const std::size_t size_, const T &value) { owned().resize(size_, value); sync(); }
+            void clear()
+            {
+                items.clear();
+                borrowed = false;
+                sync();
+            }
+            void shrink_to_fit() { owned().shrink_to_fit(); sync(); }
+            void push_back(const T &item) { owned().push_back(item); sync(); }
+            void pop_back() { owned().pop_back(); sync(); }
 
-            if (right - left <= nodeSize)
+            template <typename... TArgs>
+            void emplace_back(TArgs &&...args)
             {
-                for (auto i = left; i <= right; i++)
-                {
-                    const TNumber x = std::get<0>(points[i]);
-                    const TNumber y = std::get<1>(points[i]);
-                    if (sqDist(x, y, qx, qy) <= r2)
-                        visitor(ids[i]);
-                }
-                return;
+                owned().emplace_back(std::forward<TArgs>(args)...);
+                sync();
             }
 
-            const TIndex m = (left + right) >> 1;
-            const TNumber x = std::get<0>(points[m]);
-            const TNumber y = std::get<1>(points[m]);
+            template <typename TIter>
+            void assign(const TIter items_begin, const TIter items_end)
+            {
+                owned().assign(items_begin, items_end);
+                sync();
+            }
 
-            if (sqDist(x, y, qx, qy) <= r2)
-                visitor(ids[m]);
+            template <typename TIter>
+            void insert(const T *at, const TIter items_begin, const TIter items_end)
+            {
+                auto &vector = owned();
+                vector.insert(vector.begin() + (at - first), items_begin, items_end);
+                sync();
+            }
 
-            if (axis == 0 ? qx - r <= x : qy - r <= y)
-                within(qx, qy, r, visitor, left, m - 1, (axis + 1) % 2);
+        private:
+            std::vector<T> items;
+            // items.data() and items.size(), or the borrowed items
+            T *first = nullptr;
+            std::size_t count = 0;
+            bool borrowed = false;
 
-            if (axis == 0 ? qx + r >= x : qy + r >= y)
-                within(qx, qy, r, visitor, m + 1, right, (axis + 1) % 2);
-        }
+            std::vector<T> &owned()
+            {
+                if (borrowed)
+                {
+                    items.assign(first, first + count);
+                    borrowed = false;
+                }
+                return items;
+            }
 
-        void sortKD(const TIndex left, const TIndex right, const std::uint8_t axis)
-        {
-            if (right - left <= nodeSize)
-                return;
-            const TIndex m = (left + right) >> 1;
-            if (axis == 0)
+            void sync()
             {
-                select<0>(m, left, right);
+                first = items.data();
+                count = items.size();
             }
-            else
+
+            void reset()
             {
-                select<1>(m, left, right);
+                items.clear();
+                borrowed = false;
+                sync();
             }
-            sortKD(left, m - 1, (axis + 1) % 2);
-            sortKD(m + 1, right, (axis + 1) % 2);
-        }
+        };
+    } // namespace detail
 
-        template <std::uint8_t I>
-        void select(const TIndex k, TIndex left, TIndex right)
+    namespace detail
+    {
+        // Maps query coordinates into the storage domain of a KD-tree. Trees storing coordinates
+        // with less precision than the input widen every query, so a point is never missed but
+        // some points just outside of the query may be reported; callers filter those against
+        // the exact coordinates.
+        template <typename TNumber, typename TCoord>
+        class CoordCodec
         {
+        public:
+            using TCompare = TCoord; // type used for the comparisons during traversal
 
-            while (right > left)
+            void fit(const TNumber *xs, const TNumber *ys, const std::size_t size)
             {
-                if (right - left > 600)
-                {
-                    const double n = right - left + 1;
-                    const double m = k - left + 1;
-                    const double z = std::log(n);
-                    const double s = 0.5 * std::exp(2 * z / 3);
-                    const double r =
-                        k - m * s / n + 0.5 * std::sqrt(z * s * (1 - s / n)) * (2 * m < n ? -1 : 1);
-                    select<I>(k, std::max(left, TIndex(r)), std::min(right, TIndex(r + s)));
-                }
+                for (std::size_t i = 0; i < size; i++)
+                    maxAbs = std::max({maxAbs, std::abs(xs[i]), std::abs(ys[i])});
+            }
 
-                const TNumber t = std::get<I>(points[k]);
-                TIndex i = left;
-                TIndex j = right;
+            template <std::uint8_t I>
+            TCoord encode(const TNumber v) const
+            {
+                return static_cast<TCoord>(v);
+            }
 
-                swapItem(left, k);
-                if (std::get<I>(points[right]) > t)
-                    swapItem(left, right);
+            // rounding to the nearest representable value is monotonic, so range bounds
+            // converted the same way as the points never exclude one of them
+            template <std::uint8_t I>
+            TCompare lower(const TNumber v) const
+            {
+                return static_cast<TCoord>(v);
+            }
 
-                while (i < j)
-                {
-                    swapItem(i++, j--);
-                    while (std::get<I>(points[i]) < t)
-                        i++;
-                    while (std::get<I>(points[j]) > t)
-                        j--;
-                }
+            template <std::uint8_t I>
+            TCompare upper(const TNumber v) const
+            {
+                return static_cast<TCoord>(v);
+            }
 
-                if (std::get<I>(points[left]) == t)
-                    swapItem(left, j);
-                else
-                {
-                    swapItem(++j, right);
-                }
+            template <std::uint8_t I>
+            TCompare point(const TNumber v) const
+            {
+                return static_cast<TCoord>(v);
+            }
 
-                if (j <= k)
-                    left = j + 1;
-                if (k <= j)
-                    right = j - 1;
+            TCompare radius(const TNumber r, const TNumber qx, const TNumber qy) const
+            {
+                if (std::is_same<TNumber, TCoord>::value)
+                    return static_cast<TCoord>(r);
+                // covers the rounding of both points and of the distance computation
+                const TNumber slack = 4 * std::numeric_limits<TCoord>::epsilon() *
+                                      (maxAbs + std::abs(qx) + std::abs(qy) + r);
+                return static_cast<TCoord>(r + slack);
             }
-        }
 
-        void swapItem(const TIndex i, const TIndex j)
-        {
-            std::iter_swap(ids.begin() + static_cast<std::int32_t>(i), ids.begin() + static_cast<std::int32_t>(j));
-            std::iter_swap(points.begin() + static_cast<std::int32_t>(i), points.begin() + static_cast<std::int32_t>(j));
-        }
+            template <typename TWriter>
+            void write(TWriter &out) const
+            {
+                out.value(maxAbs);
+            }
 
-        TNumber sqDist(const TNumber ax, const TNumber ay, const TNumber bx, const TNumber by) const
-        {
-            auto dx = ax - bx;
-            auto dy = ay - by;
-            return dx * dx + dy * dy;
-        }
-    };
-    using Cluster = mapbox::supercluster::Cluster;
+            template <typename TReader>
+            void read(TReader &in)
+            {
+                maxAbs = in.template value<TNumber>();
+            }
 
-    template <>
-    struct nth<0, Cluster>
-    {
-        inline static double get(const Cluster &c)
-        {
-            return c.pos.x;
+        private:
+            TNumber maxAbs = 0;
         };
-    };
-    template <>
-    struct nth<1, Cluster>
-    {
-        inline static double get(const Cluster &c)
+
+        // 32-bit fixed point coordinates on a grid spanning the bounding box of the points.
+        // Both axes share the same scale, so distances can be compared in grid units.
+        template <typename TNumber>
+        class CoordCodec<TNumber, std::uint32_t>
         {
-            return c.pos.y;
-        };
-    };
+        public:
+            using TCompare = TNumber;
 
-} // namespace kdbush
+            void fit(const TNumber *xs, const TNumber *ys, const std::size_t size)
+            {
+                if (size == 0)
+                    return;
+                const auto x = std::minmax_element(xs, xs + size);
+                const auto y = std::minmax_element(ys, ys + size);
+                offset[0] = *x.first;
+                offset[1] = *y.first;
+                const TNumber span = std::max(*x.second - *x.first, *y.second - *y.first);
+                scale = span > 0 ? TNumber(std::numeric_limits<std::uint32_t>::max()) / span : 1;
+            }
 
-namespace mapbox
-{
-    namespace supercluster
-    {
+            template <std::uint8_t I>
+            std::uint32_t encode(const TNumber v) const
+            {
+                const TNumber grid = std::round(toGrid<I>(v));
+                return static_cast<std::uint32_t>(
+                    std::max(TNumber(0), std::min(grid, TNumber(std::numeric_limits<std::uint32_t>::max()))));
+            }
 
-#ifdef DEBUG_TIMER
-        class Timer
-        {
-        public:
-            std::chrono::high_resolution_clock::time_point started;
-            Timer()
+            // one grid unit of slack covers rounding to the nearest grid point
+            template <std::uint8_t I>
+            TCompare lower(const TNumber v) const
             {
-                started = std::chrono::high_resolution_clock::now();
+                return toGrid<I>(v) - 1;
             }
-            void operator()(std::string msg)
+
+            template <std::uint8_t I>
+            TCompare upper(const TNumber v) const
             {
-                const auto now = std::chrono::high_resolution_clock::now();
-                const auto ms = std::chrono::duration_cast<std::chrono::microseconds>(now - started);
-                std::cerr << msg << ": " << double(ms.count()) / 1000 << "ms\n";
-                started = now;
+                return toGrid<I>(v) + 1;
+            }
+
+            template <std::uint8_t I>
+            TCompare point(const TNumber v) const
+            {
+                return toGrid<I>(v);
+            }
+
+            TCompare radius(const TNumber r, const TNumber, const TNumber) const
+            {
+                return r * scale + 2;
+            }
+
+            template <typename TWriter>
+            void write(TWriter &out) const
+            {
+                out.value(offset[0]);
+                out.value(offset[1]);
+                out.value(scale);
+            }
+
+            template <typename TReader>
+            void read(TReader &in)
+            {
+                offset[0] = in.template value<TNumber>();
+                offset[1] = in.template value<TNumber>();
+                scale = in.template value<TNumber>();
+            }
+
+        private:
+            TNumber offset[2] = {0, 0};
+            TNumber scale = 1;
+
+            template <std::uint8_t I>
+            TNumber toGrid(const TNumber v) const
+            {
+                return (v - offset[I]) * scale;
             }
         };
-#endif
+    } // namespace detail
+
+    // TCoord selects how the coordinates are stored: the point's own number type (exact), or a
+    // smaller type such as float or std::uint32_t (fixed point) that halves the tree's memory.
+    // Reduced precision trees may report points slightly outside of a query, see CoordCodec.
+    template <typename TPoint,
+              typename TIndex = std::size_t,
+              typename TCoord = typename std::decay<decltype(nth<0, TPoint>::get(std::declval<TPoint>()))>::type>
+    class KDBush
+    {
 
-        struct Options
+    public:
+        using TNumber = decltype(nth<0, TPoint>::get(std::declval<TPoint>()));
+        static_assert(
+            std::is_same<TNumber, decltype(nth<1, TPoint>::get(std::declval<TPoint>()))>::value,
+            "point component types must be identical");
+
+        using Codec = detail::CoordCodec<TNumber, TCoord>;
+        using TCompare = typename Codec::TCompare;
+
+        // whether range() and within() report exactly the matching points
+        static constexpr bool exact = std::is_same<TNumber, TCoord>::value;
+
+        static const std::uint8_t defaultNodeSize = 64;
+
+        KDBush(const std::uint8_t nodeSize_ = defaultNodeSize) : nodeSize(nodeSize_)
         {
-            std::uint8_t minZoom = 0;   // min zoom to generate clusters on
-            std::uint8_t maxZoom = 16;  // max zoom level to cluster the points on
-            std::uint16_t radius = 40;  // cluster radius in pixels
-            std::uint16_t extent = 512; // tile extent (radius is calculated relative to it)
-            std::size_t minPoints = 2;  // minimum points to form a cluster
-            bool generateId = false;    // whether to generate numeric ids for input features (in vector tiles)
+        }
 
-            std::function<property_map(const property_map &)> map =
-                [](const property_map &p) -> property_map
-            { return p; };
-            std::function<void(property_map &, const property_map &)> reduce{nullptr};
-        };
+        KDBush(const std::vector<TPoint> &points_, const std::uint8_t nodeSize_ = defaultNodeSize)
+            : KDBush(std::begin(points_), std::end(points_), nodeSize_)
+        {
+        }
 
-        class Supercluster
+        template <typename TPointIter>
+        KDBush(const TPointIter &points_begin,
+               const TPointIter &points_end,
+               const std::uint8_t nodeSize_ = defaultNodeSize)
+            : nodeSize(nodeSize_)
         {
-            using GeoJSONPoint = point<double>;
-            using GeoJSONFeature = mapbox::feature::feature<double>;
-            using GeoJSONFeatures = feature_collection<double>;
+            fill(points_begin, points_end);
+        }
 
-            using TilePoint = point<std::int16_t>;
-            using TileFeature = mapbox::feature::feature<std::int16_t>;
-            using TileFeatures = feature_collection<std::int16_t>;
+        // threads > 1 sorts independent subtrees concurrently, the resulting layout is the same
+        void fill(const std::vector<TPoint> &points_, const std::size_t threads = 1)
+        {
+            fill(std::begin(points_), std::end(points_), threads);
+        }
 
-        public:
-            const GeoJSONFeatures features;
-            const Options options;
+        template <typename TPointIter>
+        void fill(const TPointIter &points_begin, const TPointIter &points_end, const std::size_t threads = 1)
+        {
+            assert(ids.empty());
+            const TIndex size = static_cast<TIndex>(std::distance(points_begin, points_end));
 
-            Supercluster(const GeoJSONFeatures &features_, Options options_ = Options())
-                : features(features_), options(std::move(options_))
+            if (size == 0)
+                return;
+
+            // the tree is always sorted with full precision keys, so a reduced precision tree
+            // has the same layout as an exact one
+            std::vector<TNumber> keysX;
+            std::vector<TNumber> keysY;
+            keysX.reserve(size);
+            keysY.reserve(size);
+            ids.reserve(size);
+
+            TIndex i = 0;
+            for (auto p = points_begin; p != points_end; p++)
             {
+                keysX.push_back(nth<0, TPoint>::get(*p));
+                keysY.push_back(nth<1, TPoint>::get(*p));
+                ids.push_back(i++);
+            }
 
-#ifdef DEBUG_TIMER
-                Timer timer;
-#endif
-                // convert and index initial points
-                zooms.emplace(options.maxZoom + 1, Zoom(features, options));
-#ifdef DEBUG_TIMER
-                timer(std::to_string(features.size()) + " initial points");
-#endif
-                for (int z = options.maxZoom; z >= options.minZoom; z--)
+            sortX = keysX.data();
+            sortY = keysY.data();
+            sortKD(0, size - 1, 0, threads);
+            sortX = sortY = nullptr;
+
+            if constexpr (exact)
+            {
+                xs = std::move(keysX);
+                ys = std::move(keysY);
+            }
+            else
+            {
+                codec.fit(keysX.data(), keysY.data(), size);
+                xs.reserve(size);
+                ys.reserve(size);
+                for (TIndex k = 0; k < size; k++)
                 {
-                    // cluster points from the previous zoom level
-                    const double r = options.radius / (options.extent * std::pow(2, z));
-                    zooms.emplace(z, Zoom(zooms[z + 1], r, z, options));
-#ifdef DEBUG_TIMER
-                    timer(std::to_string(zooms[z].clusters.size()) + " clusters");
-#endif
+                    xs.push_back(codec.template encode<0>(keysX[k]));
+                    ys.push_back(codec.template encode<1>(keysY[k]));
                 }
             }
+        }
 
-            TileFeatures
-            getTile(const std::uint8_t z, const std::uint32_t x_, const std::uint32_t y) const
-            {
-                TileFeatures result;
+        // Both queries report matching ids to visitor(id), which may return false to stop the
+        // traversal early; they return false if it was stopped.
+        template <typename TVisitor>
+        bool range(const TNumber minX,
+                   const TNumber minY,
+                   const TNumber maxX,
+                   const TNumber maxY,
+                   const TVisitor &visitor) const
+        {
+            if (ids.empty())
+                return true;
 
-                const auto zoom_iter = zooms.find(limitZoom(z));
-                assert(zoom_iter != zooms.end());
-                const auto &zoom = zoom_iter->second;
+            const TCompare qMinX = codec.template lower<0>(minX);
+            const TCompare qMinY = codec.template lower<1>(minY);
+            const TCompare qMaxX = codec.template upper<0>(maxX);
+            const TCompare qMaxY = codec.template upper<1>(maxY);
+            const auto visit = [&](const std::size_t i)
+            { return detail::visitContinue(visitor, ids[i]); };
 
-                std::uint32_t z2 = std::pow(2, z);
-                const double r = static_cast<double>(options.radius) / options.extent;
-                std::int32_t x = x_;
+            Node stack[maxDepth];
+            std::size_t top = 0;
+            stack[top++] = {0, static_cast<TIndex>(ids.size() - 1), 0};
+
+            while (top > 0)
+            {
+                const Node node = stack[--top];
 
-                const auto visitor = [&, this](const auto &id)
+                if (node.right - node.left <= nodeSize)
                 {
-                    assert(id < zoom.clusters.size());
-                    const auto &c = zoom.clusters[id];
+                    if (!detail::scanRange(xs.data(), ys.data(), node.left, std::size_t(node.right) + 1,
+                                           qMinX, qMinY, qMaxX, qMaxY, visit))
+                        return false;
+                    continue;
+                }
 
-                    const TilePoint point(::round(this->options.extent * (c.pos.x * z2 - x)),
-                                          ::round(this->options.extent * (c.pos.y * z2 - y)));
+                const TIndex m = (node.left + node.right) >> 1;
+                const TCompare x = xs[m];
+                const TCompare y = ys[m];
 
-                    if (c.num_points == 1)
-                    {
-                        const auto &original_feature = this->features[c.id];
-                        // Generate feature id if options.generateId is set.
-                        auto featureId = options.generateId ? identifier{static_cast<std::uint64_t>(c.id)} : original_feature.id;
-                        result.emplace_back(point, original_feature.properties, std::move(featureId));
-                    }
-                    else
-                    {
-                        result.emplace_back(point, c.getProperties(),
-                                            identifier(static_cast<std::uint64_t>(c.id)));
-                    }
-                };
+                if (x >= qMinX && x <= qMaxX && y >= qMinY && y <= qMaxY && !visit(m))
+                    return false;
 
-                const double top = (y - r) / z2;
-                const double bottom = (y + 1 + r) / z2;
+                // the left half is pushed last so it is visited first, like the recursive order
+                const std::uint8_t axis = node.axis ^ 1;
+                if (node.axis == 0 ? qMaxX >= x : qMaxY >= y)
+                    stack[top++] = {m + 1, node.right, axis};
+                if (node.axis == 0 ? qMinX <= x : qMinY <= y)
+                    stack[top++] = {node.left, m - 1, axis};
+            }
+            return true;
+        }
 
-                zoom.tree.range((x - r) / z2, top, (x + 1 + r) / z2, bottom, visitor);
+        template <typename TVisitor>
+        bool within(const TNumber qx, const TNumber qy, const TNumber r, const TVisitor &visitor) const
+        {
+            if (ids.empty())
+                return true;
 
-                if (x_ == 0)
-                {
-                    x = z2;
-                    zoom.tree.range(1 - r / z2, top, 1, bottom, visitor);
-                }
-                if (x_ == z2 - 1)
+            const TCompare cx = codec.template point<0>(qx);
+            const TCompare cy = codec.template point<1>(qy);
+            const TCompare cr = codec.radius(r, qx, qy);
+            const TCompare r2 = cr * cr;
+            const auto visit = [&](const std::size_t i)
+            { return detail::visitContinue(visitor, ids[i]); };
+
+            Node stack[maxDepth];
+            std::size_t top = 0;
+            stack[top++] = {0, static_cast<TIndex>(ids.size() - 1), 0};
+
+            while (top > 0)
+            {
+                const Node node = stack[--top];
+
+                if (node.right - node.left <= nodeSize)
                 {
-                    x = -1;
-                    zoom.tree.range(0, top, r / z2, bottom, visitor);
+                    if (!detail::scanWithin(xs.data(), ys.data(), node.left, std::size_t(node.right) + 1,
+                                            cx, cy, r2, visit))
+                        return false;
+                    continue;
                 }
 
-                return result;
+                const TIndex m = (node.left + node.right) >> 1;
+                const TCompare x = xs[m];
+                const TCompare y = ys[m];
+
+                if (sqDist(x, y, cx, cy) <= r2 && !visit(m))
+                    return false;
+
+                const std::uint8_t axis = node.axis ^ 1;
+                if (node.axis == 0 ? cx + cr >= x : cy + cr >= y)
+                    stack[top++] = {m + 1, node.right, axis};
+                if (node.axis == 0 ? cx - cr <= x : cy - cr <= y)
+                    stack[top++] = {node.left, m - 1, axis};
             }
+            return true;
+        }
 
-            GeoJSONFeatures getClusters(double bbox[4], std::uint8_t zoomArg)
-            {
-                GeoJSONFeatures result;
+        std::size_t memoryUsage() const
+        {
+            return ids.capacity() * sizeof(TIndex) + (xs.capacity() + ys.capacity()) * sizeof(TCoord);
+        }
 
-                double minLng = std::fmod(std::fmod((bbox[0] + 180.0), 360.0) + 360.0, 360) - 180;
-                const double minLat = std::max(-90.0, std::min(90.0, bbox[1]));
-                double maxLng = bbox[2] == 180 ? 180 : std::fmod(std::fmod(bbox[2] + 180.0, 360.0) + 360.0, 360) - 180;
-                const double maxLat = std::max(-90.0, std::min(90.0, bbox[3]));
+        // The sorted tree as stored, so a tree can be restored without sorting it again (see
+        // Supercluster::serialize). Readers throw for arrays of different lengths.
+        template <typename TWriter>
+        void write(TWriter &out) const
+        {
+            out.array(ids);
+            out.array(xs);
+            out.array(ys);
+            codec.write(out);
+        }
 
-                if (bbox[2] - bbox[0] >= 360)
+        bool idsBelow(const std::size_t size) const
+        {
+            return std::all_of(ids.begin(), ids.end(), [&](const TIndex id)
+                               { return std::size_t(id) < size; });
+        }
+
+        template <typename TReader>
+        void read(TReader &in)
+        {
+            assert(ids.empty());
+            in.array(ids);
+            in.array(xs);
+            in.array(ys);
+            codec.read(in);
+            in.expect(xs.size() == ids.size() && ys.size() == ids.size());
+        }
+
+    protected:
+        // struct-of-arrays: coordinates of the i-th tree entry are xs[i], ys[i]
+        detail::Array<TIndex> ids;
+        detail::Array<TCoord> xs;
+        detail::Array<TCoord> ys;
+
+    private:
+        const std::uint8_t nodeSize;
+        Codec codec;
+
+        // full precision coordinates while the tree is sorted
+        TNumber *sortX = nullptr;
+        TNumber *sortY = nullptr;
+
+        // Subtree [left, right] waiting to be traversed. Every split halves the range, so the
+        // explicit stack never holds more than one pending sibling per level.
+        struct Node
+        {
+            TIndex left;
+            TIndex right;
+            std::uint8_t axis;
+        };
+        static constexpr std::size_t maxDepth = std::numeric_limits<TIndex>::digits + 1;
+
+        // subtrees smaller than this are always sorted on the current thread
+        static constexpr TIndex parallelMinSize = 1 << 16;
+
+        void sortKD(const TIndex left, const TIndex right, const std::uint8_t axis, const std::size_t threads = 1)
+        {
+            if (right - left <= nodeSize)
+                return;
+            const TIndex m = (left + right) >> 1;
+            if (axis == 0)
+            {
+                select<0>(m, left, right);
+            }
+            else
+            {
+                select<1>(m, left, right);
+            }
+
+            // both halves are disjoint ranges once the median is in place
+            if (threads > 1 && right - left >= parallelMinSize)
+            {
+                std::thread worker;
+                try
                 {
-                    minLng = -180;
-                    maxLng = 180;
+                    worker = std::thread([=, this]
+                                         { sortKD(left, m - 1, (axis + 1) % 2, threads / 2); });
                 }
-                else if (minLng > maxLng)
+                catch (const std::system_error &)
                 {
-                    double eastBbox[4] = {minLng, minLat, 180, maxLat};
-                    double westBbox[4] = {-180, minLat, maxLng, maxLat};
-                    const GeoJSONFeatures easternHem = getClusters(eastBbox, zoomArg);
-                    const GeoJSONFeatures westernHem = getClusters(westBbox, zoomArg);
-                    result.insert(result.end(), easternHem.begin(), easternHem.end());
-                    result.insert(result.end(), westernHem.begin(), westernHem.end());
-                    return result;
+                    // no thread available, sort both halves here
+                    sortKD(left, m - 1, (axis + 1) % 2, 1);
                 }
+                sortKD(m + 1, right, (axis + 1) % 2, threads - threads / 2);
+                if (worker.joinable())
+                    worker.join();
+                return;
+            }
 
-                const auto zoom_iter = zooms.find(limitZoom(zoomArg));
-                assert(zoom_iter != zooms.end());
-                const auto &zoom = zoom_iter->second;
+            sortKD(left, m - 1, (axis + 1) % 2);
+            sortKD(m + 1, right, (axis + 1) % 2);
+        }
+
+        template <std::uint8_t I>
+        void select(const TIndex k, TIndex left, TIndex right)
+        {
 
-                const auto visitor = [&, this](const auto &id)
+            while (right > left)
+            {
+                if (right - left > 600)
                 {
-                    assert(id < zoom.clusters.size());
-                    const mapbox::supercluster::Cluster &c = zoom.clusters[id];
+                    const double n = right - left + 1;
+                    const double m = k - left + 1;
+                    const double z = std::log(n);
+                    const double s = 0.5 * std::exp(2 * z / 3);
+                    const double r =
+                        k - m * s / n + 0.5 * std::sqrt(z * s * (1 - s / n)) * (2 * m < n ? -1 : 1);
+                    select<I>(k, std::max(left, TIndex(r)), std::min(right, TIndex(r + s)));
+                }
 
-                    result.emplace_back(clusterToGeoJSON(c));
-                };
+                const TNumber t = coord<I>(k);
+                TIndex i = left;
+                TIndex j = right;
 
-                zoom.tree.range(lngX(minLng), latY(maxLat), lngX(maxLng), latY(minLat), visitor);
+                swapItem(left, k);
+                if (coord<I>(right) > t)
+                    swapItem(left, right);
 
-                return result;
+                while (i < j)
+                {
+                    swapItem(i++, j--);
+                    while (coord<I>(i) < t)
+                        i++;
+                    while (coord<I>(j) > t)
+                        j--;
+                }
+
+                if (coord<I>(left) == t)
+                    swapItem(left, j);
+                else
+                {
+                    swapItem(++j, right);
+                }
+
+                if (j <= k)
+                    left = j + 1;
+                if (k <= j)
+                    right = j - 1;
+            }
+        }
+
+        void swapItem(const TIndex i, const TIndex j)
+        {
+            std::iter_swap(ids.begin() + static_cast<std::int32_t>(i), ids.begin() + static_cast<std::int32_t>(j));
+            std::swap(sortX[i], sortX[j]);
+            std::swap(sortY[i], sortY[j]);
+        }
+
+        template <std::uint8_t I>
+        TNumber coord(const TIndex i) const
+        {
+            return I == 0 ? sortX[i] : sortY[i];
+        }
+
+        TCompare sqDist(const TCompare ax, const TCompare ay, const TCompare bx, const TCompare by) const
+        {
+            auto dx = ax - bx;
+            auto dy = ay - by;
+            return dx * dx + dy * dy;
+        }
+    };
+    using Cluster = mapbox::supercluster::Cluster;
+
+    template <>
+    struct nth<0, Cluster>
+    {
+        inline static double get(const Cluster &c)
+        {
+            return c.pos.x;
+        };
+    };
+    template <>
+    struct nth<1, Cluster>
+    {
+        inline static double get(const Cluster &c)
+        {
+            return c.pos.y;
+        };
+    };
+
+} // namespace kdbush
+
+namespace mapbox
+{
+    namespace supercluster
+    {
+
+#ifdef DEBUG_TIMER
+        class Timer
+        {
+        public:
+            std::chrono::high_resolution_clock::time_point started;
+            Timer()
+            {
+                started = std::chrono::high_resolution_clock::now();
+            }
+            void operator()(std::string msg)
+            {
+                const auto now = std::chrono::high_resolution_clock::now();
+                const auto ms = std::chrono::duration_cast<std::chrono::microseconds>(now - started);
+                std::cerr << msg << ": " << double(ms.count()) / 1000 << "ms\n";
+                started = now;
+            }
+        };
+#endif
+
+        namespace detail
+        {
+            // Runs fn(0) .. fn(tasks - 1) concurrently, fn(0) on the calling thread.
+            // The first exception thrown by a task is rethrown once all tasks are done.
+            template <typename TFn>
+            void parallelFor(const std::size_t tasks, const TFn &fn)
+            {
+                std::exception_ptr error;
+                std::atomic_flag failed = ATOMIC_FLAG_INIT;
+                const auto run = [&](const std::size_t task)
+                {
+                    try
+                    {
+                        fn(task);
+                    }
+                    catch (...)
+                    {
+                        if (!failed.test_and_set())
+                            error = std::current_exception();
+                    }
+                };
+
+                std::vector<std::thread> workers;
+                workers.reserve(tasks > 0 ? tasks - 1 : 0);
+                for (std::size_t task = 1; task < tasks; task++)
+                    workers.emplace_back(run, task);
+                run(0);
+                for (auto &worker : workers)
+                    worker.join();
+
+                if (error)
+                    std::rethrow_exception(error);
+            }
+        } // namespace detail
+
+        // Cluster property computed natively while clustering, a declarative alternative to
+        // Options::map / Options::reduce. Points that lack a numeric value for the property are
+        // left out of sum, min, max, mean and count.
+        struct Aggregate
+        {
+            enum class Op : std::uint8_t
+            {
+                Sum,
+                Min,
+                Max,
+                Count, // number of points, or of points having the property if one is set
+                Mean
+            };
+
+            std::string name;     // cluster property to write
+            Op op = Op::Sum;      // how point values are combined
+            std::string property; // point property to read
+        };
+
+        namespace detail
+        {
+            // Compiled form of Options::aggregates: every cluster owns a row of `stride` doubles,
+            // merging two clusters combines their rows slot by slot.
+            class Accumulators
+            {
+            public:
+                explicit Accumulators(const std::vector<Aggregate> &aggregates_) : aggregates(aggregates_)
+                {
+                    for (const auto &aggregate : aggregates_)
+                    {
+                        offsets.push_back(stride);
+                        stride += aggregate.op == Aggregate::Op::Mean ? 2 : 1; // mean keeps sum and count
+                    }
+                }
+
+                std::size_t size() const
+                {
+                    return stride;
+                }
+
+                // appends the row of a single point
+                template <typename TRows>
+                void append(TRows &rows, const property_map &properties) const
+                {
+                    for (std::size_t a = 0; a < aggregates.size(); a++)
+                    {
+                        const auto &aggregate = aggregates[a];
+                        double v = 0;
+                        const bool has = numericValue(properties, aggregate.property, v);
+                        switch (aggregate.op)
+                        {
+                        case Aggregate::Op::Sum:
+                            rows.push_back(has ? v : 0);
+                            break;
+                        case Aggregate::Op::Min:
+                            rows.push_back(has ? v : std::numeric_limits<double>::infinity());
+                            break;
+                        case Aggregate::Op::Max:
+                            rows.push_back(has ? v : -std::numeric_limits<double>::infinity());
+                            break;
+                        case Aggregate::Op::Count:
+                            rows.push_back(has || aggregate.property.empty() ? 1 : 0);
+                            break;
+                        case Aggregate::Op::Mean:
+                            rows.push_back(has ? v : 0);
+                            rows.push_back(has ? 1 : 0);
+                            break;
+                        }
+                    }
+                }
+
+                // combines the point or cluster row `from` into `into`
+                void merge(double *into, const double *from) const
+                {
+                    for (std::size_t a = 0; a < aggregates.size(); a++)
+                    {
+                        const auto o = offsets[a];
+                        switch (aggregates[a].op)
+                        {
+                        case Aggregate::Op::Min:
+                            into[o] = std::min(into[o], from[o]);
+                            break;
+                        case Aggregate::Op::Max:
+                            into[o] = std::max(into[o], from[o]);
+                            break;
+                        case Aggregate::Op::Mean:
+                            into[o + 1] += from[o + 1];
+                            into[o] += from[o];
+                            break;
+                        default:
+                            into[o] += from[o];
+                            break;
+                        }
+                    }
+                }
+
+                // writes the aggregates of a row, min, max and mean are left out if no point had a value
+                void output(property_map &properties, const double *row) const
+                {
+                    for (std::size_t a = 0; a < aggregates.size(); a++)
+                    {
+                        const auto &aggregate = aggregates[a];
+                        const auto o = offsets[a];
+                        switch (aggregate.op)
+                        {
+                        case Aggregate::Op::Count:
+                            properties[aggregate.name] = static_cast<std::uint64_t>(row[o]);
+                            break;
+                        case Aggregate::Op::Mean:
+                            if (row[o + 1] > 0)
+                                properties[aggregate.name] = row[o] / row[o + 1];
+                            break;
+                        default:
+                            if (std::isfinite(row[o]))
+                                properties[aggregate.name] = row[o];
+                            break;
+                        }
+                    }
+                }
+
+            private:
+                std::vector<Aggregate> aggregates;
+                std::vector<std::size_t> offsets;
+                std::size_t stride = 0;
+
+                static bool numericValue(const property_map &properties, const std::string &key, double &v)
+                {
+                    if (key.empty())
+                        return false;
+                    const auto it = properties.find(key);
+                    if (it == properties.end())
+                        return false;
+                    const auto &value = it->second;
+                    if (value.is<double>())
+                        v = value.get<double>();
+                    else if (value.is<std::uint64_t>())
+                        v = static_cast<double>(value.get<std::uint64_t>());
+                    else if (value.is<std::int64_t>())
+                        v = static_cast<double>(value.get<std::int64_t>());
+                    else
+                        return false;
+                    return true;
+                }
+            };
+
+            // Least recently used getTile results within a byte budget (Options::tileCacheSize).
+            // Tiles are shared, so a tile handed out stays valid after it has been evicted.
+            class TileCache
+            {
+            public:
+                using Tile = feature_collection<std::int16_t>;
+
+                struct Stats
+                {
+                    std::size_t hits = 0;
+                    std::size_t misses = 0;
+                    std::size_t tiles = 0; // currently cached
+                    std::size_t bytes = 0; // approximate size of the cached tiles
+                };
+
+                explicit TileCache(const std::size_t budget_) : budget(budget_) {}
+
+                bool enabled() const
+                {
+                    return budget > 0;
+                }
+
+                // tiles are keyed by (z, x, y), coordinates of 29 bits or more are not cacheable
+                static bool cacheable(const std::uint32_t x, const std::uint32_t y)
+                {
+                    return x < (1u << 29) && y < (1u << 29);
+                }
+
+                static std::uint64_t key(const std::uint8_t z, const std::uint32_t x, const std::uint32_t y)
+                {
+                    return (std::uint64_t(z) << 58) | (std::uint64_t(x) << 29) | y;
+                }
+
+                std::shared_ptr<const Tile> find(const std::uint64_t key)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    const auto it = index.find(key);
+                    if (it == index.end())
+                    {
+                        stats.misses++;
+                        return nullptr;
+                    }
+                    stats.hits++;
+                    entries.splice(entries.begin(), entries, it->second);
+                    return it->second->tile;
+                }
+
+                void insert(const std::uint64_t key, std::shared_ptr<const Tile> tile)
+                {
+                    const auto bytes = tileBytes(*tile);
+                    if (bytes > budget)
+                        return;
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (index.count(key))
+                        return;
+                    entries.push_front({key, std::move(tile), bytes});
+                    index.emplace(key, entries.begin());
+                    stats.tiles++;
+                    stats.bytes += bytes;
+
+                    while (stats.bytes > budget)
+                    {
+                        const auto &last = entries.back();
+                        stats.tiles--;
+                        stats.bytes -= last.bytes;
+                        index.erase(last.key);
+                        entries.pop_back();
+                    }
+                }
+
+                // drops all tiles, the counters are kept
+                void clear()
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    entries.clear();
+                    index.clear();
+                    stats.tiles = 0;
+                    stats.bytes = 0;
+                }
+
+                Stats statistics() const
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return stats;
+                }
+
+            private:
+                struct Entry
+                {
+                    std::uint64_t key;
+                    std::shared_ptr<const Tile> tile;
+                    std::size_t bytes;
+                };
+
+                // approximate heap usage of a tile, including the cache bookkeeping
+                static std::size_t tileBytes(const Tile &tile)
+                {
+                    std::size_t bytes = sizeof(Entry) + 4 * sizeof(void *) + sizeof(Tile) +
+                                        tile.capacity() * sizeof(Tile::value_type);
+                    for (const auto &feature : tile)
+                    {
+                        bytes += feature.properties.bucket_count() * sizeof(void *);
+                        for (const auto &property : feature.properties)
+                        {
+                            bytes += sizeof(property) + 2 * sizeof(void *) + property.first.capacity();
+                            if (property.second.is<std::string>())
+                                bytes += property.second.get<std::string>().capacity();
+                        }
+                    }
+                    return bytes;
+                }
+
+                const std::size_t budget;
+                std::list<Entry> entries; // most recently used first
+                std::unordered_map<std::uint64_t, std::list<Entry>::iterator> index;
+                Stats stats;
+                mutable std::mutex mutex;
+            };
+
+            // Checksum ending a snapshot, over the bytes before it. Each 8 byte word goes through a
+            // bijection of the running value, so any corrupted word changes the result.
+            inline std::uint64_t snapshotChecksum(const char *data, const std::size_t size)
+            {
+                constexpr std::uint64_t multiplier = 0xff51afd7ed558ccdULL;
+                std::uint64_t h = 0x9e3779b97f4a7c15ULL ^ size;
+                std::size_t at = 0;
+                for (; at < size; at += 8)
+                {
+                    std::uint64_t word = 0;
+                    std::memcpy(&word, data + at, std::min<std::size_t>(8, size - at));
+                    h = (h ^ word) * multiplier;
+                    h ^= h >> 32;
+                }
+                return h;
+            }
+
+            // Encoding of Supercluster::serialize(): fixed-width values in the byte order of the
+            // host (checked when reading), and arrays prefixed with their length and aligned to 8
+            // bytes from the start of the snapshot, so a snapshot can be loaded at any address.
+            // The snapshot ends with its snapshotChecksum().
+            class SnapshotWriter
+            {
+            public:
+                std::string bytes;
+
+                template <typename T>
+                void value(const T v)
+                {
+                    static_assert(std::is_trivially_copyable<T>::value, "fixed-width values only");
+                    const auto at = bytes.size();
+                    bytes.resize(at + sizeof(T));
+                    std::memcpy(&bytes[at], &v, sizeof(T));
+                }
+
+                void string(const std::string &s)
+                {
+                    value<std::uint64_t>(s.size());
+                    bytes.append(s);
+                }
+
+                void align()
+                {
+                    bytes.resize((bytes.size() + 7) & ~std::size_t(7), '\0');
+                }
+
+                template <typename TItems>
+                void array(const TItems &items)
+                {
+                    using T = typename TItems::value_type;
+                    static_assert(std::is_trivially_copyable<T>::value, "fixed-width values only");
+                    value<std::uint64_t>(items.size());
+                    align();
+                    const auto at = bytes.size();
+                    bytes.resize(at + items.size() * sizeof(T));
+                    if (!items.empty())
+                        std::memcpy(&bytes[at], items.data(), items.size() * sizeof(T));
+                }
+
+                void identifier(const mapbox::feature::identifier &id)
+                {
+                    if (id.is<std::uint64_t>())
+                    {
+                        value<std::uint8_t>(1);
+                        value(id.get<std::uint64_t>());
+                    }
+                    else if (id.is<std::int64_t>())
+                    {
+                        value<std::uint8_t>(2);
+                        value(id.get<std::int64_t>());
+                    }
+                    else if (id.is<double>())
+                    {
+                        value<std::uint8_t>(3);
+                        value(id.get<double>());
+                    }
+                    else if (id.is<std::string>())
+                    {
+                        value<std::uint8_t>(4);
+                        string(id.get<std::string>());
+                    }
+                    else
+                    {
+                        value<std::uint8_t>(0);
+                    }
+                }
+
+                void property(const mapbox::feature::value &v)
+                {
+                    if (v.is<bool>())
+                    {
+                        value<std::uint8_t>(1);
+                        value<std::uint8_t>(v.get<bool>());
+                    }
+                    else if (v.is<std::uint64_t>())
+                    {
+                        value<std::uint8_t>(2);
+                        value(v.get<std::uint64_t>());
+                    }
+                    else if (v.is<std::int64_t>())
+                    {
+                        value<std::uint8_t>(3);
+                        value(v.get<std::int64_t>());
+                    }
+                    else if (v.is<double>())
+                    {
+                        value<std::uint8_t>(4);
+                        value(v.get<double>());
+                    }
+                    else if (v.is<std::string>())
+                    {
+                        value<std::uint8_t>(5);
+                        string(v.get<std::string>());
+                    }
+                    else if (v.is<std::vector<mapbox::feature::value>>())
+                    {
+                        const auto &items = v.get<std::vector<mapbox::feature::value>>();
+                        value<std::uint8_t>(6);
+                        value<std::uint64_t>(items.size());
+                        for (const auto &item : items)
+                            property(item);
+                    }
+                    else if (v.is<property_map>())
+                    {
+                        value<std::uint8_t>(7);
+                        properties(v.get<property_map>());
+                    }
+                    else
+                    {
+                        value<std::uint8_t>(0);
+                    }
+                }
+
+                // in key order, so equal indexes give equal snapshots
+                void properties(const property_map &p)
+                {
+                    std::vector<const property_map::value_type *> entries;
+                    entries.reserve(p.size());
+                    for (const auto &entry : p)
+                        entries.push_back(&entry);
+                    std::sort(entries.begin(), entries.end(), [](const auto *a, const auto *b)
+                              { return a->first < b->first; });
+                    value<std::uint64_t>(entries.size());
+                    for (const auto *entry : entries)
+                    {
+                        string(entry->first);
+                        property(entry->second);
+                    }
+                }
+            };
+
+            // Reads what SnapshotWriter wrote, throwing std::runtime_error for snapshots that are
+            // truncated or otherwise malformed instead of reading past their end. Corrupted
+            // snapshots are told apart by their checksum (see checksumValid()). A borrowing
+            // reader reads a mapped snapshot (see MappedFile): arrays read into a
+            // kdbush::detail::Array use the items in place instead of copying them.
+            class SnapshotReader
+            {
+            public:
+                SnapshotReader(const char *data_, const std::size_t size_, const bool borrowing_ = false)
+                    : data(data_), size(size_), borrowing(borrowing_)
+                {
+                }
+
+                bool borrows() const
+                {
+                    return borrowing;
+                }
+
+                // whether the snapshot ends with the snapshotChecksum() of the bytes before it
+                bool checksumValid() const
+                {
+                    if (size < sizeof(std::uint64_t))
+                        return false;
+                    std::uint64_t checksum;
+                    std::memcpy(&checksum, data + size - sizeof(checksum), sizeof(checksum));
+                    return checksum == snapshotChecksum(data, size - sizeof(checksum));
+                }
+
+                void expect(const bool valid) const
+                {
+                    if (!valid)
+                        throw std::runtime_error("Invalid snapshot.");
+                }
+
+                template <typename T>
+                T value()
+                {
+                    static_assert(std::is_trivially_copyable<T>::value, "fixed-width values only");
+                    expect(size - at >= sizeof(T));
+                    T v;
+                    std::memcpy(&v, data + at, sizeof(T));
+                    at += sizeof(T);
+                    return v;
+                }
+
+                std::string string()
+                {
+                    const auto length = value<std::uint64_t>();
+                    expect(length <= size - at);
+                    std::string s(data + at, length);
+                    at += length;
+                    return s;
+                }
+
+                void align()
+                {
+                    const auto aligned = (at + 7) & ~std::size_t(7);
+                    expect(aligned <= size);
+                    at = aligned;
+                }
+
+                // the items of the next array, in place
+                template <typename T>
+                const char *array(std::size_t &length)
+                {
+                    const auto count = value<std::uint64_t>();
+                    align();
+                    expect(count <= (size - at) / sizeof(T));
+                    length = static_cast<std::size_t>(count);
+                    const char *items = data + at;
+                    at += length * sizeof(T);
+                    return items;
+                }
+
+                template <typename T>
+                void array(std::vector<T> &items)
+                {
+                    std::size_t length = 0;
+                    const char *bytes = array<T>(length);
+                    items.resize(length);
+                    if (length > 0)
+                        std::memcpy(items.data(), bytes, length * sizeof(T));
+                }
+
+                // Items of a borrowing reader stay in the mapped file, which is aligned and
+                // writable like the snapshot it was written from.
+                template <typename T>
+                void array(kdbush::detail::Array<T> &items)
+                {
+                    std::size_t length = 0;
+                    const char *bytes = array<T>(length);
+                    if (borrowing)
+                    {
+                        items.borrow(reinterpret_cast<T *>(const_cast<char *>(bytes)), length);
+                        return;
+                    }
+                    items.resize(length);
+                    if (length > 0)
+                        std::memcpy(items.data(), bytes, length * sizeof(T));
+                }
+
+                mapbox::feature::identifier identifier()
+                {
+                    switch (value<std::uint8_t>())
+                    {
+                    case 0:
+                        return mapbox::feature::null_value;
+                    case 1:
+                        return value<std::uint64_t>();
+                    case 2:
+                        return value<std::int64_t>();
+                    case 3:
+                        return value<double>();
+                    case 4:
+                        return string();
+                    default:
+                        expect(false);
+                        return mapbox::feature::null_value;
+                    }
+                }
+
+                mapbox::feature::value property(const std::size_t depth = 0)
+                {
+                    expect(depth < maxDepth);
+                    switch (value<std::uint8_t>())
+                    {
+                    case 0:
+                        return mapbox::feature::null_value;
+                    case 1:
+                        return value<std::uint8_t>() != 0;
+                    case 2:
+                        return value<std::uint64_t>();
+                    case 3:
+                        return value<std::int64_t>();
+                    case 4:
+                        return value<double>();
+                    case 5:
+                        return string();
+                    case 6:
+                    {
+                        const auto length = value<std::uint64_t>();
+                        expect(length <= size - at);
+                        std::vector<mapbox::feature::value> items;
+                        items.reserve(length);
+                        for (std::uint64_t k = 0; k < length; k++)
+                            items.push_back(property(depth + 1));
+                        return items;
+                    }
+                    case 7:
+                        return properties(depth + 1);
+                    default:
+                        expect(false);
+                        return mapbox::feature::null_value;
+                    }
+                }
+
+                property_map properties(const std::size_t depth = 0)
+                {
+                    const auto length = value<std::uint64_t>();
+                    expect(length <= size - at);
+                    property_map p;
+                    for (std::uint64_t k = 0; k < length; k++)
+                    {
+                        auto key = string();
+                        p.emplace(std::move(key), property(depth));
+                    }
+                    return p;
+                }
+
+            private:
+                static constexpr std::size_t maxDepth = 64; // nested arrays and objects
+                const char *data;
+                std::size_t size;
+                bool borrowing;
+                std::size_t at = 0;
+            };
+
+#ifdef SUPERCLUSTER_MMAP
+            // A snapshot file mapped copy-on-write: pages are read from the file when first
+            // touched and can be dropped again by the OS under memory pressure, writes stay
+            // private to the process.
+            class MappedFile
+            {
+            public:
+                explicit MappedFile(const std::string &path)
+                {
+                    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                    if (fd < 0)
+                        throw std::runtime_error("Cannot open snapshot " + path + ".");
+                    struct stat st;
+                    if (::fstat(fd, &st) != 0)
+                    {
+                        ::close(fd);
+                        throw std::runtime_error("Cannot read snapshot " + path + ".");
+                    }
+                    size = static_cast<std::size_t>(st.st_size);
+                    void *mapping = size > 0 ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                                             : nullptr;
+                    ::close(fd);
+                    if (mapping == MAP_FAILED)
+                        throw std::runtime_error("Cannot map snapshot " + path + ".");
+                    data = static_cast<char *>(mapping);
+                }
+
+                ~MappedFile()
+                {
+                    if (data)
+                        ::munmap(data, size);
+                }
+
+                MappedFile(const MappedFile &) = delete;
+                MappedFile &operator=(const MappedFile &) = delete;
+
+                char *data = nullptr;
+                std::size_t size = 0;
+            };
+#endif
+        } // namespace detail
+
+        // coordinate storage of the per zoom KD-trees, see kdbush::KDBush
+        enum class IndexPrecision : std::uint8_t
+        {
+            Double,   // 16 bytes per point, exact
+            Float,    // 8 bytes per point
+            Quantized // 8 bytes per point, 32-bit fixed point over the bounding box of each level
+        };
+
+        struct Options
+        {
+            std::uint8_t minZoom = 0;   // min zoom to generate clusters on
+            std::uint8_t maxZoom = 16;  // max zoom level to cluster the points on
+            std::uint16_t radius = 40;  // cluster radius in pixels
+            std::uint16_t extent = 512; // tile extent (radius is calculated relative to it)
+            std::size_t minPoints = 2;  // minimum points to form a cluster
+            bool generateId = false;    // whether to generate numeric ids for input features (in vector tiles)
+            std::size_t threads = 1;    // threads used to cluster each zoom level (0 = one per CPU core)
+            IndexPrecision precision = IndexPrecision::Double; // KD-tree coordinates, results are identical
+            std::size_t tileCacheSize = 0; // bytes of getTile results to keep (0 = no tile cache)
+            bool lazyZooms = false;        // build the zoom levels below maxZoom + 1 when first queried
+
+            // map and reduce may be called concurrently when threads != 1
+            std::function<property_map(const property_map &)> map =
+                [](const property_map &p) -> property_map
+            { return p; };
+            std::function<void(property_map &, const property_map &)> reduce{nullptr};
+
+            // natively computed cluster properties, read from the points' properties
+            std::vector<Aggregate> aggregates;
+
+            // called after each zoom level has been indexed (profiling hook, see benchmark/)
+            std::function<void(std::uint8_t zoom, std::size_t clusters)> onZoomIndexed{nullptr};
+
+            // polled before each zoom level is clustered, returning true stops the build with
+            // BuildCancelled (used to abandon background builds that have been superseded)
+            std::function<bool()> cancelled{nullptr};
+        };
+
+        struct BuildCancelled : std::runtime_error
+        {
+            BuildCancelled() : std::runtime_error("Index build cancelled.") {}
+        };
+
+        class Supercluster
+        {
+            using GeoJSONPoint = point<double>;
+            using GeoJSONFeature = mapbox::feature::feature<double>;
+            using GeoJSONFeatures = feature_collection<double>;
+
+            using TilePoint = point<std::int16_t>;
+            using TileFeature = mapbox::feature::feature<std::int16_t>;
+            using TileFeatures = feature_collection<std::int16_t>;
+
+        public:
+            GeoJSONFeatures features; // loaded points, followed by the ones added with insert()
+            const Options options;
+
+            Supercluster(const GeoJSONFeatures &features_, Options options_ = Options())
+                : features(features_), options(std::move(options_)), accumulators(options.aggregates),
+                  tileCache(options.tileCacheSize)
+            {
+
+#ifdef DEBUG_TIMER
+                Timer timer;
+#endif
+                // convert and index initial points
+                zooms.emplace(options.maxZoom + 1, Zoom(features, options));
+#ifdef DEBUG_TIMER
+                timer(std::to_string(features.size()) + " initial points");
+#endif
+                clusterZooms();
+            }
+
+            // Indexes `size` points given as interleaved longitude / latitude pairs, without
+            // GeoJSON features. Points are reported with ids[i] as feature id (i without ids) and
+            // no properties, so callers keep point data on their side and look it up by id.
+            Supercluster(const double *lngLat_,
+                         const std::size_t size,
+                         const std::uint32_t *ids_ = nullptr,
+                         Options options_ = Options())
+                : options(std::move(options_)), accumulators(options.aggregates),
+                  tileCache(options.tileCacheSize), lngLat(std::vector<double>(lngLat_, lngLat_ + 2 * size))
+            {
+                if (ids_)
+                    pointIds.assign(ids_, ids_ + size);
+
+                zooms.emplace(options.maxZoom + 1, Zoom(lngLat.data(), size, options));
+                clusterZooms();
+            }
+
+            // Adds points to an index loaded from GeoJSON features, with point indices following the
+            // existing ones. Rather than rebuilding, every zoom level only reclusters the
+            // neighborhoods of the clusters that changed on the level below it, so the cost grows
+            // with the number of points changed instead of the size of the index. Zoom levels are
+            // brought up to date by the first query that reads them (see settle()), so a level is
+            // only reclustered once for any number of updates in between. Clusters are formed by
+            // the same rules as a full build, but may differ from the ones a rebuild would pick.
+            void insert(const GeoJSONFeatures &points)
+            {
+                if (!lngLat.empty())
+                    throw std::logic_error("Supercluster loaded from coordinates, insert coordinates.");
+
+                auto &base = zooms[options.maxZoom + 1];
+                LevelChanges changes;
+                for (const auto &f : points)
+                {
+                    const auto i = static_cast<std::uint32_t>(features.size());
+                    features.push_back(f);
+                    addPoint(base, i, project(f.geometry.get<GeoJSONPoint>()), f.properties);
+                    changes.added.push_back(i);
+                }
+                update(std::move(changes));
+            }
+
+            // Adds `size` longitude / latitude pairs to an index loaded from coordinates, see insert().
+            void insert(const double *lngLat_, const std::size_t size, const std::uint32_t *ids_ = nullptr)
+            {
+                if (!features.empty())
+                    throw std::logic_error("Supercluster loaded from features, insert features.");
+
+                auto &base = zooms[options.maxZoom + 1];
+                const auto first = static_cast<std::uint32_t>(lngLat.size() / 2);
+                // points keep their index as id unless an id is given for one of them
+                if (ids_ && pointIds.empty())
+                    for (std::uint32_t i = 0; i < first; i++)
+                        pointIds.push_back(i);
+
+                const property_map empty;
+                LevelChanges changes;
+                for (std::size_t k = 0; k < size; k++)
+                {
+                    const auto i = static_cast<std::uint32_t>(first + k);
+                    lngLat.push_back(lngLat_[2 * k]);
+                    lngLat.push_back(lngLat_[2 * k + 1]);
+                    if (!pointIds.empty())
+                    {
+                        pointIds.push_back(ids_ ? ids_[k] : i);
+                        if (!pointIndexById.empty())
+                            pointIndexById[pointIds.back()] = i;
+                    }
+                    addPoint(base, i, project(GeoJSONPoint(lngLat_[2 * k], lngLat_[2 * k + 1])), empty);
+                    changes.added.push_back(i);
+                }
+                update(std::move(changes));
+            }
+
+            // Removes points by id, the id they are reported with for an index loaded from
+            // coordinates, otherwise their index. Unknown ids are skipped, returns the number of
+            // points removed. Neighborhoods are reclustered as with insert().
+            std::size_t remove(const std::uint32_t *ids_, const std::size_t size)
+            {
+                auto &base = zooms[options.maxZoom + 1];
+                LevelChanges changes;
+                for (std::size_t k = 0; k < size; k++)
+                {
+                    const auto i = pointIndex(ids_[k]);
+                    if (i >= base.clusters.size() || base.clusters[i].num_points == 0)
+                        continue;
+                    auto &c = base.clusters[i];
+                    changes.changed.emplace_back(i, c);
+                    c.num_points = 0;
+                    base.dead++;
+                    if (!pointIds.empty() && !pointIndexById.empty())
+                        pointIndexById.erase(pointIds[i]);
+                }
+                const auto removed = changes.changed.size();
+                update(std::move(changes));
+                return removed;
+            }
+
+            // Moves points, identified as with remove(), to new longitude / latitude pairs. Only
+            // the moved points are projected again. Zoom levels are brought up to date as with
+            // insert(): clusters whose members only moved are shifted along, and only the
+            // neighborhoods of points that left or joined a cluster are reclustered. Unknown ids
+            // are skipped, returns the number of points moved.
+            std::size_t updatePositions(const std::uint32_t *ids_, const double *lngLat_, const std::size_t size)
+            {
+                auto &base = zooms[options.maxZoom + 1];
+                LevelChanges changes;
+                for (std::size_t k = 0; k < size; k++)
+                {
+                    const auto i = pointIndex(ids_[k]);
+                    if (i >= base.clusters.size() || base.clusters[i].num_points == 0)
+                        continue;
+                    const GeoJSONPoint p(lngLat_[2 * k], lngLat_[2 * k + 1]);
+                    const auto pos = project(p);
+                    auto &c = base.clusters[i];
+                    if (pos.x == c.pos.x && pos.y == c.pos.y)
+                        continue;
+                    changes.moved.emplace_back(i, c);
+                    c.pos = pos;
+                    base.touch(i);
+                    if (lngLat.empty())
+                    {
+                        features[i].geometry = p;
+                    }
+                    else
+                    {
+                        lngLat[2 * i] = p.x;
+                        lngLat[2 * i + 1] = p.y;
+                    }
+                }
+                // a point given more than once keeps its state before the first move
+                const auto byIndex = [](const auto &a, const auto &b)
+                { return a.first < b.first; };
+                const auto sameIndex = [](const auto &a, const auto &b)
+                { return a.first == b.first; };
+                std::stable_sort(changes.moved.begin(), changes.moved.end(), byIndex);
+                changes.moved.erase(std::unique(changes.moved.begin(), changes.moved.end(), sameIndex),
+                                    changes.moved.end());
+                const auto moved = changes.moved.size();
+                update(std::move(changes));
+                return moved;
+            }
+
+            TileFeatures
+            getTile(const std::uint8_t z, const std::uint32_t x, const std::uint32_t y) const
+            {
+                if (!tileCache.enabled())
+                    return makeTile(z, x, y);
+                return *getSharedTile(z, x, y);
+            }
+
+            // getTile without copying cached tiles
+            std::shared_ptr<const TileFeatures>
+            getSharedTile(const std::uint8_t z, const std::uint32_t x, const std::uint32_t y) const
+            {
+                if (!tileCache.enabled() || !detail::TileCache::cacheable(x, y))
+                    return std::make_shared<const TileFeatures>(makeTile(z, x, y));
+
+                const auto key = detail::TileCache::key(z, x, y);
+                if (auto tile = tileCache.find(key))
+                    return tile;
+                auto tile = std::make_shared<const TileFeatures>(makeTile(z, x, y));
+                tileCache.insert(key, tile);
+                return tile;
+            }
+
+            using TileCacheStats = detail::TileCache::Stats;
+
+            TileCacheStats tileCacheStats() const
+            {
+                return tileCache.statistics();
+            }
+
+            // Visits the clusters and points of getTile with their tile coordinates, without
+            // building features.
+            template <typename TVisitor>
+            void eachTileCluster(const std::uint8_t z,
+                                 const std::uint32_t x_,
+                                 const std::uint32_t y,
+                                 const TVisitor &visitor) const
+            {
+                settle(limitZoom(z));
+                const auto zoom_iter = zooms.find(limitZoom(z));
+                assert(zoom_iter != zooms.end());
+                const auto &zoom = zoom_iter->second;
+
+                std::uint32_t z2 = std::pow(2, z);
+                const double r = static_cast<double>(options.radius) / options.extent;
+                std::int32_t x = x_;
+
+                const auto tileVisitor = [&, this](const auto &id)
+                {
+                    assert(id < zoom.clusters.size());
+                    const auto &c = zoom.clusters[id];
+
+                    const TilePoint point(::round(this->options.extent * (c.pos.x * z2 - x)),
+                                          ::round(this->options.extent * (c.pos.y * z2 - y)));
+                    visitor(c, point);
+                };
+
+                const double top = (y - r) / z2;
+                const double bottom = (y + 1 + r) / z2;
+
+                zoom.range((x - r) / z2, top, (x + 1 + r) / z2, bottom, tileVisitor);
+
+                if (x_ == 0)
+                {
+                    x = z2;
+                    zoom.range(1 - r / z2, top, 1, bottom, tileVisitor);
+                }
+                if (x_ == z2 - 1)
+                {
+                    x = -1;
+                    zoom.range(0, top, r / z2, bottom, tileVisitor);
+                }
+            }
+
+            GeoJSONFeatures getClusters(double bbox[4], std::uint8_t zoomArg)
+            {
+                GeoJSONFeatures result;
+                eachCluster(bbox, zoomArg, [&, this](const Cluster &c)
+                            { result.emplace_back(this->clusterToGeoJSON(c)); });
+                return result;
+            }
+
+            // Visits the clusters and points of getClusters, without building features.
+            template <typename TVisitor>
+            void eachCluster(const double bbox[4], const std::uint8_t zoomArg, const TVisitor &visitor) const
+            {
+                double minLng = std::fmod(std::fmod((bbox[0] + 180.0), 360.0) + 360.0, 360) - 180;
+                const double minLat = std::max(-90.0, std::min(90.0, bbox[1]));
+                double maxLng = bbox[2] == 180 ? 180 : std::fmod(std::fmod(bbox[2] + 180.0, 360.0) + 360.0, 360) - 180;
+                const double maxLat = std::max(-90.0, std::min(90.0, bbox[3]));
+
+                if (bbox[2] - bbox[0] >= 360)
+                {
+                    minLng = -180;
+                    maxLng = 180;
+                }
+                else if (minLng > maxLng)
+                {
+                    const double eastBbox[4] = {minLng, minLat, 180, maxLat};
+                    const double westBbox[4] = {-180, minLat, maxLng, maxLat};
+                    eachCluster(eastBbox, zoomArg, visitor);
+                    eachCluster(westBbox, zoomArg, visitor);
+                    return;
+                }
+
+                settle(limitZoom(zoomArg));
+                const auto zoom_iter = zooms.find(limitZoom(zoomArg));
+                assert(zoom_iter != zooms.end());
+                const auto &zoom = zoom_iter->second;
+
+                zoom.range(lngX(minLng), latY(maxLat), lngX(maxLng), latY(minLat), [&](const auto &id)
+                           {
+                    assert(id < zoom.clusters.size());
+                    visitor(zoom.clusters[id]); });
+            }
+
+            // Changes between two getClusters results, see diffClusters.
+            struct ClusterDiff
+            {
+                GeoJSONFeatures added;
+                std::vector<std::uint64_t> addedKeys; // clusterKey of each added feature
+                std::vector<std::uint64_t> removed;   // clusterKey of each removed feature
+                std::size_t unchanged = 0;
+            };
+
+            // Identifies a cluster or point across queries. Cluster ids encode their zoom level, so
+            // clusters of another zoom are different clusters, while a point keeps its key.
+            static std::uint64_t clusterKey(const Cluster &c)
+            {
+                return c.num_points > 1 ? c.id : (std::uint64_t(1) << 32) | c.id;
+            }
+
+            // A cluster or point returned by diffClusters: its clusterKey, and a digest of its
+            // position and size, which changes when an update moves it or changes its members.
+            struct VisibleCluster
+            {
+                std::uint64_t key;
+                std::uint64_t digest;
+            };
+
+            static std::uint64_t clusterDigest(const Cluster &c)
+            {
+                const auto x = std::bit_cast<std::uint64_t>(c.pos.x);
+                const auto y = std::bit_cast<std::uint64_t>(c.pos.y);
+                return (x * 0x9e3779b97f4a7c15ull) ^ (y * 0xc2b2ae3d27d4eb4full) ^ c.num_points;
+            }
+
+            // getClusters as changes since the previous call with the same `visible` clusters,
+            // which are updated to the result of this query. Clusters changed by an update in
+            // between are reported as removed and added again. Only added clusters are turned into
+            // features.
+            ClusterDiff diffClusters(const double bbox[4],
+                                     const std::uint8_t zoom,
+                                     std::vector<VisibleCluster> &visible) const
+            {
+                std::vector<std::pair<std::uint64_t, const Cluster *>> current;
+                eachCluster(bbox, zoom, [&](const Cluster &c)
+                            { current.emplace_back(clusterKey(c), &c); });
+                std::sort(current.begin(), current.end(),
+                          [](const auto &a, const auto &b)
+                          { return a.first < b.first; });
+                // a query crossing the antimeridian may report clusters at +-180 twice
+                current.erase(std::unique(current.begin(), current.end(),
+                                          [](const auto &a, const auto &b)
+                                          { return a.first == b.first; }),
+                              current.end());
+
+                ClusterDiff diff;
+                std::size_t i = 0, j = 0;
+                while (i < current.size() || j < visible.size())
+                {
+                    if (j == visible.size() || (i < current.size() && current[i].first < visible[j].key))
+                    {
+                        diff.added.emplace_back(clusterToGeoJSON(*current[i].second));
+                        diff.addedKeys.push_back(current[i].first);
+                        i++;
+                    }
+                    else if (i == current.size() || visible[j].key < current[i].first)
+                    {
+                        diff.removed.push_back(visible[j].key);
+                        j++;
+                    }
+                    else
+                    {
+                        if (visible[j].digest == clusterDigest(*current[i].second))
+                        {
+                            diff.unchanged++;
+                        }
+                        else
+                        {
+                            diff.removed.push_back(visible[j].key);
+                            diff.added.emplace_back(clusterToGeoJSON(*current[i].second));
+                            diff.addedKeys.push_back(current[i].first);
+                        }
+                        i++;
+                        j++;
+                    }
+                }
+
+                visible.resize(current.size());
+                for (std::size_t k = 0; k < current.size(); k++)
+                    visible[k] = {current[k].first, clusterDigest(*current[k].second)};
+                return diff;
+            }
+
+            // Longitude / latitude of c, as loaded for single points.
+            point<double> coordinates(const Cluster &c) const
+            {
+                if (c.num_points > 1)
+                    return c.lngLat();
+                if (!lngLat.empty())
+                    return {lngLat[2 * c.id], lngLat[2 * c.id + 1]};
+                return features[c.id].geometry.template get<GeoJSONPoint>();
+            }
+
+            GeoJSONFeatures getChildren(const std::uint32_t cluster_id) const
+            {
+                GeoJSONFeatures children;
+                eachChild(cluster_id,
+                          [&, this](const auto &c)
+                          { children.push_back(this->clusterToGeoJSON(c)); });
+                return children;
+            }
+
+            GeoJSONFeatures getLeaves(const std::uint32_t cluster_id,
+                                      const std::uint32_t limit = 10,
+                                      const std::uint32_t offset = 0) const
+            {
+                GeoJSONFeatures leaves;
+                std::uint32_t skipped = 0;
+                std::uint32_t limit_ = limit;
+                eachLeaf(cluster_id, limit_, offset, skipped,
+                         [&, this](const auto &c)
+                         { leaves.push_back(this->clusterToGeoJSON(c)); });
+                return leaves;
+            }
+
+            // Whether cluster_id names a cluster of this index; the lookups below throw for ids
+            // that do not. Ids are positions in the index, so an id kept from another index or
+            // from before updates may name an unrelated cluster of this one.
+            bool hasCluster(const std::uint32_t cluster_id) const
+            {
+                return tryEachChild(cluster_id, [](const Cluster &)
+                                    { return false; });
+            }
+
+            // Same as getChildren, getLeaves and getClusterExpansionZoom, but returning nothing
+            // instead of throwing for ids that are no cluster of the index.
+            std::optional<GeoJSONFeatures> tryGetChildren(const std::uint32_t cluster_id) const
+            {
+                GeoJSONFeatures children;
+                if (!tryEachChild(cluster_id,
+                                  [&, this](const auto &c)
+                                  { children.push_back(this->clusterToGeoJSON(c)); }))
+                    return std::nullopt;
+                return children;
+            }
+
+            std::optional<GeoJSONFeatures> tryGetLeaves(const std::uint32_t cluster_id,
+                                                        const std::uint32_t limit = 10,
+                                                        const std::uint32_t offset = 0) const
+            {
+                if (!hasCluster(cluster_id))
+                    return std::nullopt;
+                return getLeaves(cluster_id, limit, offset);
+            }
+
+            std::optional<std::uint8_t> tryGetClusterExpansionZoom(const std::uint32_t cluster_id) const
+            {
+                // only clusters have a recorded expansion zoom
+                if (const auto recorded = recordedExpansionZoom(cluster_id))
+                    return recorded;
+                if (!hasCluster(cluster_id))
+                    return std::nullopt;
+                return getClusterExpansionZoom(cluster_id);
+            }
+
+            struct MemoryUsage
+            {
+                std::size_t count = 0;    // cluster records of all zoom levels
+                std::size_t clusters = 0; // cluster records, aggregate rows, property pointers, child and leaf lists, bounds
+                std::size_t trees = 0;    // KD-trees of all zoom levels
+            };
+
+            // approximate heap usage of the index, not counting features and cluster properties,
+            // the zoom levels not built yet (Options::lazyZooms) or what is used in place in a
+            // mapped snapshot (mapSnapshot)
+            MemoryUsage memoryUsage() const
+            {
+                // levels may be built by a concurrent query
+                std::lock_guard<std::mutex> lock(settleMutex);
+                MemoryUsage usage;
+                for (const auto &entry : zooms)
+                {
+                    const auto &zoom = entry.second;
+                    usage.count += zoom.clusters.size();
+                    usage.clusters += zoom.clusters.capacity() * sizeof(Cluster) +
+                                      zoom.aggregates.capacity() * sizeof(double) +
+                                      zoom.properties.capacity() * sizeof(std::unique_ptr<property_map>) +
+                                      (zoom.childOffsets.capacity() + zoom.children.capacity() + zoom.leafBegin.capacity() +
+                                       zoom.up.capacity()) *
+                                          sizeof(std::uint32_t) +
+                                      zoom.clusterBounds.capacity() * sizeof(float);
+                    usage.trees += zoom.treeMemoryUsage();
+                }
+                usage.clusters += leafOrder.capacity() * sizeof(std::uint32_t);
+                return usage;
+            }
+
+            std::uint8_t getClusterExpansionZoom(std::uint32_t cluster_id) const
+            {
+                if (const auto recorded = recordedExpansionZoom(cluster_id))
+                    return recorded;
+                auto cluster_zoom = (cluster_id % 32) - 1;
+                while (cluster_zoom <= options.maxZoom)
+                {
+                    std::uint32_t num_children = 0;
+
+                    eachChild(cluster_id, [&](const auto &c)
+                              {
+                num_children++;
+                cluster_id = c.id;
+                // two children are enough to know the cluster splits here
+                return num_children < 2; });
+
+                    cluster_zoom++;
+
+                    if (num_children != 1)
+                        break;
+                }
+                return cluster_zoom;
+            }
+
+            // getClusterExpansionZoom of a cluster returned by a query, without a lookup unless
+            // the index changed since it was built; 0 for points
+            std::uint8_t expansionZoom(const Cluster &c) const
+            {
+                if (c.num_points < 2)
+                    return 0;
+                if (c.expansion_zoom != 0 && expansionZoomsRecorded.load(std::memory_order_acquire))
+                    return c.expansion_zoom;
+                return getClusterExpansionZoom(c.id);
+            }
+
+            // Bounding box of the points of a cluster, [westLng, southLat, eastLng, northLat] like
+            // the bbox of getClusters. Recorded by the build, computed from the leaves once updates
+            // changed the index.
+            std::array<double, 4> getClusterBounds(const std::uint32_t cluster_id) const
+            {
+                std::array<double, 4> bounds;
+                if (recordedBounds(cluster_id, bounds))
+                    return bounds;
+                constexpr auto inf = std::numeric_limits<double>::infinity();
+                bounds = {inf, inf, -inf, -inf};
+                std::uint32_t limit = std::numeric_limits<std::uint32_t>::max();
+                std::uint32_t skipped = 0;
+                eachLeaf(cluster_id, limit, 0, skipped, [&](const Cluster &leaf)
+                         {
+                    const auto p = coordinates(leaf);
+                    bounds[0] = std::min(bounds[0], p.x);
+                    bounds[1] = std::min(bounds[1], p.y);
+                    bounds[2] = std::max(bounds[2], p.x);
+                    bounds[3] = std::max(bounds[3], p.y); });
+                return bounds;
+            }
+
+            // getClusterBounds of every cluster of a query result, and the position of its points,
+            // given the ids of the items and whether they are clusters as in the columnar results.
+            // Writes four numbers per item to out, NaN for items no longer in the index.
+            void getClustersBounds(const std::uint32_t *ids,
+                                   const std::uint8_t *isCluster,
+                                   const std::size_t size,
+                                   double *out) const
+            {
+                const auto &base = zooms.find(options.maxZoom + 1)->second;
+                for (std::size_t k = 0; k < size; k++)
+                {
+                    std::array<double, 4> bounds;
+                    bounds.fill(std::numeric_limits<double>::quiet_NaN());
+                    if (isCluster[k])
+                    {
+                        if (hasCluster(ids[k]))
+                            bounds = getClusterBounds(ids[k]);
+                    }
+                    else if (ids[k] < base.clusters.size() && base.clusters[ids[k]].num_points > 0)
+                    {
+                        const auto p = coordinates(base.clusters[ids[k]]);
+                        bounds = {p.x, p.y, p.x, p.y};
+                    }
+                    std::copy(bounds.begin(), bounds.end(), out + 4 * k);
+                }
+            }
+
+            // Saves the index as a binary snapshot that deserialize() restores without clustering
+            // again: the points, and every zoom level with its KD-tree, parent ids, child lists
+            // and map / reduce results. Pending updates are applied first, levels not built yet
+            // (Options::lazyZooms) are left out. Snapshots are read back by hosts of the same byte
+            // order.
+            std::string serialize() const
+            {
+                settle(static_cast<std::uint8_t>(std::max<int>(builtZoom.load(), options.minZoom)));
+                std::lock_guard<std::mutex> lock(settleMutex);
+
+                detail::SnapshotWriter out;
+                out.bytes.append(snapshotMagic, sizeof(snapshotMagic));
+                out.value(snapshotVersion);
+                out.value(snapshotByteOrder);
+                writeOptions(out, options);
+
+                out.value<std::uint8_t>(lngLat.empty() ? 0 : 1);
+                if (lngLat.empty())
+                {
+                    out.value<std::uint64_t>(features.size());
+                    for (const auto &f : features)
+                    {
+                        const auto &p = f.geometry.get<GeoJSONPoint>();
+                        out.value(p.x);
+                        out.value(p.y);
+                        out.identifier(f.id);
+                        out.properties(f.properties);
+                    }
+                }
+                else
+                {
+                    out.array(lngLat);
+                    out.array(pointIds);
+                }
+
+                const int built = builtZoom.load();
+                out.value<std::int32_t>(built);
+                for (int z = options.maxZoom + 1; z >= built; z--)
+                    zooms.find(z)->second.write(out);
+                out.array(leafOrder);
+                out.value<std::uint8_t>(expansionZoomsRecorded.load() ? 1 : 0);
+                out.value<std::uint8_t>(boundsRecorded.load() ? 1 : 0);
+                out.value(detail::snapshotChecksum(out.bytes.data(), out.bytes.size()));
+                return std::move(out.bytes);
+            }
+
+            // Restores an index saved with serialize(). The options that shape the clusters
+            // (zoom range, radius, extent, minPoints, precision, aggregates and whether reduce is
+            // set) must be the ones the snapshot was built with, otherwise std::invalid_argument
+            // is thrown; malformed or corrupted snapshots throw std::runtime_error.
+            static std::unique_ptr<Supercluster> deserialize(const char *snapshot,
+                                                             const std::size_t size,
+                                                             Options options_ = Options())
+            {
+                detail::SnapshotReader in(snapshot, size);
+                return std::unique_ptr<Supercluster>(new Supercluster(in, std::move(options_)));
+            }
+
+            // deserialize() of the snapshot saved in a file
+            static std::unique_ptr<Supercluster> deserializeFile(const std::string &path, Options options_ = Options())
+            {
+                std::ifstream file(path, std::ios::binary | std::ios::ate);
+                if (!file)
+                    throw std::runtime_error("Cannot open snapshot " + path + ".");
+                std::string bytes(static_cast<std::size_t>(file.tellg()), '\0');
+                file.seekg(0);
+                if (!file.read(&bytes[0], static_cast<std::streamsize>(bytes.size())))
+                    throw std::runtime_error("Cannot read snapshot " + path + ".");
+                return deserialize(bytes.data(), bytes.size(), std::move(options_));
+            }
+
+            // Opens a snapshot file saved with serialize() without reading it: the KD-trees, the
+            // records of every zoom level and the coordinates of an index loaded from coordinates
+            // are queried in place in the mapped file, so opening takes a few page reads whatever
+            // the size of the index, and pages are loaded as queries touch them. Features and
+            // map / reduce properties are still decoded. Array lengths are checked as with
+            // deserialize(), the checksum and the contents of the arrays are trusted. Updates copy
+            // the arrays they resize to memory first; the file must not be changed while the index
+            // is in use. Without mmap the file is read as with deserializeFile().
+            static std::unique_ptr<Supercluster> mapSnapshot(const std::string &path, Options options_ = Options())
+            {
+#ifdef SUPERCLUSTER_MMAP
+                auto file = std::make_unique<detail::MappedFile>(path);
+                detail::SnapshotReader in(file->data, file->size, true);
+                std::unique_ptr<Supercluster> index(new Supercluster(in, std::move(options_)));
+                index->mapped = std::move(file);
+                return index;
+#else
+                return deserializeFile(path, std::move(options_));
+#endif
+            }
+
+        private:
+            static constexpr char snapshotMagic[4] = {'S', 'C', 'L', 'X'};
+            static constexpr std::uint32_t snapshotVersion = 6;
+            static constexpr std::uint32_t snapshotByteOrder = 0x01020304;
+
+            Supercluster(detail::SnapshotReader &in, Options options_)
+                : options(std::move(options_)), accumulators(options.aggregates),
+                  tileCache(options.tileCacheSize)
+            {
+                char magic[sizeof(snapshotMagic)];
+                for (auto &c : magic)
+                    c = in.value<char>();
+                in.expect(std::equal(magic, magic + sizeof(magic), snapshotMagic));
+                const auto version = in.value<std::uint32_t>();
+                if (version != snapshotVersion)
+                    throw std::runtime_error("Unsupported snapshot version " + std::to_string(version) + ".");
+                if (in.value<std::uint32_t>() != snapshotByteOrder)
+                    throw std::runtime_error("Snapshot saved on a host of another byte order.");
+                // reading every page of a mapped snapshot would defeat mapping it
+                in.expect(in.borrows() || in.checksumValid());
+                detail::SnapshotWriter expected;
+                writeOptions(expected, options);
+                for (const auto c : expected.bytes)
+                {
+                    if (in.value<char>() != c)
+                        throw std::invalid_argument("Snapshot built with other clustering options.");
+                }
+
+                if (in.value<std::uint8_t>() == 0)
+                {
+                    const auto size = in.value<std::uint64_t>();
+                    for (std::uint64_t i = 0; i < size; i++)
+                    {
+                        const auto x = in.value<double>();
+                        const auto y = in.value<double>();
+                        auto id = in.identifier();
+                        features.emplace_back(GeoJSONPoint(x, y), in.properties(), std::move(id));
+                    }
+                }
+                else
+                {
+                    in.array(lngLat);
+                    in.array(pointIds);
+                    in.expect(lngLat.size() % 2 == 0 && (pointIds.empty() || pointIds.size() == lngLat.size() / 2));
+                }
+
+                const auto built = in.value<std::int32_t>();
+                in.expect(built <= options.maxZoom + 1 && built >= std::min<int>(options.minZoom, options.maxZoom + 1));
+                for (int z = options.maxZoom + 1; z >= std::min<int>(options.minZoom, built); z--)
+                {
+                    auto &zoom = zooms.emplace(z, Zoom()).first->second;
+                    if (z >= built)
+                        zoom.read(in, options, accumulators.size());
+                }
+                const auto points = std::max(features.size(), lngLat.size() / 2);
+                in.expect(zooms[options.maxZoom + 1].clusters.size() == points);
+                // records are checked like the trees
+                in.expect(in.borrows() || recordsValid(built, points));
+                in.array(leafOrder);
+                if (!leafOrder.empty())
+                {
+                    // leaf ranges index leafOrder, checked like the trees
+                    in.expect(built == options.minZoom);
+                    for (int z = options.maxZoom + 1; z >= built; z--)
+                        in.expect(zooms[z].leafBegin.size() == zooms[z].clusters.size());
+                    in.expect(in.borrows() || leavesValid());
+                    leavesOrdered.store(true, std::memory_order_release);
+                }
+                expansionZoomsRecorded.store(in.value<std::uint8_t>() != 0);
+                boundsRecorded.store(in.value<std::uint8_t>() != 0);
+                in.value<std::uint64_t>(); // checksum, checked above
+                builtZoom.store(built);
+                if (!options.lazyZooms)
+                    settle(options.minZoom);
+            }
+
+            // the options a snapshot is only valid with
+            static void writeOptions(detail::SnapshotWriter &out, const Options &o)
+            {
+                out.value(o.minZoom);
+                out.value(o.maxZoom);
+                out.value(o.radius);
+                out.value(o.extent);
+                out.value<std::uint64_t>(o.minPoints);
+                out.value(o.precision);
+                out.value<std::uint8_t>(o.reduce ? 1 : 0);
+                out.value<std::uint64_t>(o.aggregates.size());
+                for (const auto &aggregate : o.aggregates)
+                {
+                    out.string(aggregate.name);
+                    out.value(aggregate.op);
+                    out.string(aggregate.property);
+                }
+            }
+
+            struct Zoom
+            {
+                std::variant<kdbush::KDBush<Cluster, std::uint32_t>,
+                             kdbush::KDBush<Cluster, std::uint32_t, float>,
+                             kdbush::KDBush<Cluster, std::uint32_t, std::uint32_t>>
+                    tree;
+                kdbush::detail::Array<Cluster> clusters;
+                // Options::aggregates, a row of Accumulators::size() values per cluster
+                kdbush::detail::Array<double> aggregates;
+                // Options::map / Options::reduce results per cluster, only kept with Options::reduce
+                std::vector<std::unique_ptr<property_map>> properties;
+                // Records by the cluster of the level above they were merged into: the children of
+                // the cluster centered on record i are children[childOffsets[i]..childOffsets[i + 1]).
+                // Dropped once updates recluster the level above, eachChild then searches the
+                // cluster radius instead.
+                kdbush::detail::Array<std::uint32_t> childOffsets;
+                kdbush::detail::Array<std::uint32_t> children;
+                // where the leaves of each record start in Supercluster::leafOrder
+                kdbush::detail::Array<std::uint32_t> leafBegin;
+                // Bounding boxes of the leaves of the clusters centered on each record, as minX,
+                // minY, maxX and maxY projected and rounded outwards; empty boxes (min > max) for
+                // records that are no center. Recorded until updates change the index.
+                kdbush::detail::Array<float> clusterBounds;
+                // Build scratch: the record of the level above each record was merged into or
+                // copied to, kept until Supercluster::indexLeaves() has ordered the leaves.
+                std::vector<std::uint32_t> up;
+                // Build scratch: the position of each merged record among the children of its
+                // cluster in the order within() reports them around the center, which is the
+                // order getChildren() and getLeaves() return them in.
+                std::vector<std::uint32_t> rank;
+                static constexpr std::uint32_t noRecord = std::numeric_limits<std::uint32_t>::max();
+
+                Zoom() = default;
+
+                // Records added or changed in place by updates since the tree was filled, looked up
+                // by range() and within() in a grid of the level's cluster radius until the level
+                // is compacted.
+                std::vector<std::uint32_t> buffer;
+                std::vector<std::uint8_t> buffered; // per record, whether it is in buffer
+                double cell = 0;
+                std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> bufferCells;
+                std::unordered_map<std::uint32_t, std::uint64_t> bufferCellOf;
+                // removed records (num_points == 0), their slots are reused by add()
+                std::size_t dead = 0;
+                std::vector<std::uint32_t> freeSlots;
+
+                // As with KDBush, the visitor may return false to stop the query.
+                template <typename TVisitor>
+                bool range(const double minX,
+                           const double minY,
+                           const double maxX,
+                           const double maxY,
+                           const TVisitor &visitor) const
+                {
+                    if (buffer.empty() && dead == 0)
+                        return treeRange(minX, minY, maxX, maxY, visitor);
+
+                    if (!treeRange(minX, minY, maxX, maxY, [&](const std::uint32_t id)
+                                   { return !inTree(id) || kdbush::detail::visitContinue(visitor, id); }))
+                        return false;
+                    return eachBuffered(minX, minY, maxX, maxY, [&](const std::uint32_t id)
+                                        {
+                        const auto &c = clusters[id];
+                        return !(c.pos.x >= minX && c.pos.x <= maxX && c.pos.y >= minY && c.pos.y <= maxY) ||
+                               kdbush::detail::visitContinue(visitor, id); });
+                }
+
+                template <typename TVisitor>
+                bool within(const double qx, const double qy, const double r, const TVisitor &visitor) const
+                {
+                    if (buffer.empty() && dead == 0)
+                        return treeWithin(qx, qy, r, visitor);
+
+                    if (!treeWithin(qx, qy, r, [&](const std::uint32_t id)
+                                    { return !inTree(id) || kdbush::detail::visitContinue(visitor, id); }))
+                        return false;
+                    const double r2 = r * r;
+                    return eachBuffered(qx - r, qy - r, qx + r, qy + r, [&](const std::uint32_t id)
+                                        {
+                        const auto &c = clusters[id];
+                        const double dx = c.pos.x - qx;
+                        const double dy = c.pos.y - qy;
+                        return !(dx * dx + dy * dy <= r2) || kdbush::detail::visitContinue(visitor, id); });
+                }
+
+                // Reduced precision trees may report clusters just outside of the query, those are
+                // filtered against the exact positions so the results match the double tree.
+                template <typename TVisitor>
+                bool treeRange(const double minX,
+                               const double minY,
+                               const double maxX,
+                               const double maxY,
+                               const TVisitor &visitor) const
+                {
+                    return std::visit([&](const auto &index)
+                                      {
+                        if constexpr (std::decay_t<decltype(index)>::exact) {
+                            return index.range(minX, minY, maxX, maxY, visitor);
+                        } else {
+                            return index.range(minX, minY, maxX, maxY, [&](const std::uint32_t id) {
+                                const auto &pos = clusters[id].pos;
+                                return !(pos.x >= minX && pos.x <= maxX && pos.y >= minY && pos.y <= maxY) ||
+                                       kdbush::detail::visitContinue(visitor, id);
+                            });
+                        } },
+                                      tree);
+                }
+
+                template <typename TVisitor>
+                bool treeWithin(const double qx, const double qy, const double r, const TVisitor &visitor) const
+                {
+                    return std::visit([&](const auto &index)
+                                      {
+                        if constexpr (std::decay_t<decltype(index)>::exact) {
+                            return index.within(qx, qy, r, visitor);
+                        } else {
+                            const double r2 = r * r;
+                            return index.within(qx, qy, r, [&](const std::uint32_t id) {
+                                const auto &pos = clusters[id].pos;
+                                const double dx = pos.x - qx;
+                                const double dy = pos.y - qy;
+                                return !(dx * dx + dy * dy <= r2) || kdbush::detail::visitContinue(visitor, id);
+                            });
+                        } },
+                                      tree);
+                }
+
+                std::size_t treeMemoryUsage() const
+                {
+                    return std::visit([](const auto &index)
+                                      { return index.memoryUsage(); },
+                                      tree);
+                }
+
+                Zoom(const GeoJSONFeatures &features_, const Options &options_) : cell(baseCell(options_))
+                {
+                    // generate a cluster object for each point
+                    std::uint32_t i = 0;
+                    clusters.reserve(features_.size());
+                    for (const auto &f : features_)
+                    {
+                        clusters.emplace_back(project(f.geometry.get<GeoJSONPoint>()), 1, i++);
+                        if (options_.reduce)
+                            storeProperties(options_, properties, options_.map(f.properties));
+                    }
+
+                    const detail::Accumulators accumulators(options_.aggregates);
+                    if (accumulators.size() > 0)
+                    {
+                        aggregates.reserve(features_.size() * accumulators.size());
+                        for (const auto &f : features_)
+                            accumulators.append(aggregates, f.properties);
+                    }
+
+                    fillTree(options_, threadCount(options_));
+                }
+
+                // points without features, given as size longitude / latitude pairs
+                Zoom(const double *lngLat, const std::size_t size, const Options &options_) : cell(baseCell(options_))
+                {
+                    const property_map empty;
+                    clusters.reserve(size);
+                    for (std::uint32_t i = 0; i < size; i++)
+                    {
+                        clusters.emplace_back(project(GeoJSONPoint(lngLat[2 * i], lngLat[2 * i + 1])), 1, i);
+                        if (options_.reduce)
+                            storeProperties(options_, properties, options_.map(empty));
+                    }
+
+                    const detail::Accumulators accumulators(options_.aggregates);
+                    if (accumulators.size() > 0)
+                    {
+                        aggregates.reserve(size * accumulators.size());
+                        for (std::size_t i = 0; i < size; i++)
+                            accumulators.append(aggregates, empty);
+                    }
+
+                    fillTree(options_, threadCount(options_));
+                }
+
+                // clusters the records of the previous zoom level into this empty one
+                void cluster(Zoom &previous, const double r, const std::uint8_t zoom, const Options &options_)
+                {
+                    assert(clusters.empty());
+                    cell = r;
+
+                    // The zoom parameter is restricted to [minZoom, maxZoom] by caller
+                    assert(((zoom + 1) & 0b11111) == (zoom + 1));
+
+                    // Since point index is encoded in the upper 27 bits, clamp the count of clusters
+                    const auto previous_clusters_size = std::min(
+                        previous.clusters.size(), static_cast<std::vector<Cluster>::size_type>(0x7ffffff));
+
+                    const auto threads = threadCount(options_);
+
+                    // records removed by updates are skipped by the sequential pass only
+                    if (threads > 1 && previous_clusters_size >= parallelMinClusters && previous.dead == 0)
+                    {
+                        clusterParallel(previous, r, zoom, options_, previous_clusters_size, threads);
+                    }
+                    else
+                    {
+                        clusterSequential(previous, r, zoom, options_, previous_clusters_size);
+                    }
+
+                    // only updates grow the level from here on, drop the growth slack
+                    clusters.shrink_to_fit();
+                    aggregates.shrink_to_fit();
+                    properties.shrink_to_fit();
+
+                    fillTree(options_, threads);
+                    previous.indexChildren();
+                    recordExpansionZooms(previous, zoom);
+                }
+
+                // A cluster with several children splits on the zoom level below it, one with a
+                // single child (a cluster of the same points) wherever that child splits.
+                void recordExpansionZooms(const Zoom &previous, const std::uint8_t zoom)
+                {
+                    for (auto &c : clusters)
+                    {
+                        // clusters of one point (minPoints 1) are left to the search
+                        if (c.num_points < 2)
+                            continue;
+                        const auto center = c.id >> 5;
+                        const auto first = previous.childOffsets[center];
+                        const auto last = previous.childOffsets[center + 1];
+                        if (last - first > 1)
+                            c.expansion_zoom = static_cast<std::uint8_t>(zoom + 1);
+                        else if (last - first == 1)
+                            c.expansion_zoom = previous.clusters[previous.children[first]].expansion_zoom;
+                    }
+                }
+
+                // fills childOffsets and children from the parent ids set by cluster()
+                void indexChildren()
+                {
+                    std::vector<std::uint32_t> offsets(clusters.size() + 1, 0);
+                    for (const auto &c : clusters)
+                    {
+                        if (c.num_points > 0 && c.parent_id != 0)
+                            offsets[(c.parent_id >> 5) + 1]++;
+                    }
+                    for (std::size_t i = 1; i < offsets.size(); i++)
+                        offsets[i] += offsets[i - 1];
+                    // offsets[o] moves to the end of the children of o while they are placed,
+                    // which is where those of o + 1 begin
+                    std::vector<std::uint32_t> members(offsets.back());
+                    for (std::uint32_t i = 0; i < clusters.size(); i++)
+                    {
+                        const auto &c = clusters[i];
+                        if (c.num_points > 0 && c.parent_id != 0)
+                            members[offsets[c.parent_id >> 5]++] = i;
+                    }
+                    for (std::size_t i = offsets.size() - 1; i > 0; i--)
+                        offsets[i] = offsets[i - 1];
+                    offsets[0] = 0;
+                    // put the children of every cluster in the order they were merged in
+                    if (rank.size() == clusters.size())
+                    {
+                        for (std::size_t i = 0; i + 1 < offsets.size(); i++)
+                        {
+                            std::sort(members.begin() + offsets[i], members.begin() + offsets[i + 1],
+                                      [&](const std::uint32_t a, const std::uint32_t b)
+                                      { return rank[a] < rank[b]; });
+                        }
+                    }
+                    rank = std::vector<std::uint32_t>();
+                    childOffsets = std::move(offsets);
+                    children = std::move(members);
+                }
+
+                void dropChildren()
+                {
+                    childOffsets.clear();
+                    children.clear();
+                }
+
+                void dropLeaves()
+                {
+                    leafBegin.clear();
+                    up = std::vector<std::uint32_t>();
+                }
+
+                // Fills clusterBounds from the child lists, with the bounds of child clusters
+                // taken from the level below, which holds their centers (nullptr for the base
+                // level, which only holds points).
+                void indexBounds(const Zoom *below)
+                {
+                    constexpr auto inf = std::numeric_limits<float>::infinity();
+                    std::vector<float> result(clusters.size() * 4);
+                    for (std::size_t i = 0; i < clusters.size(); i++)
+                    {
+                        float *b = &result[i * 4];
+                        b[0] = b[1] = inf;
+                        b[2] = b[3] = -inf;
+                        const auto first = i + 1 < childOffsets.size() ? childOffsets[i] : 0;
+                        const auto last = i + 1 < childOffsets.size() ? childOffsets[i + 1] : 0;
+                        for (auto k = first; k < last; k++)
+                        {
+                            const auto &c = clusters[children[k]];
+                            if (c.num_points > 1)
+                            {
+                                const std::size_t center = c.id >> 5;
+                                if (!below || (center + 1) * 4 > below->clusterBounds.size())
+                                {
+                                    clusterBounds.clear();
+                                    return;
+                                }
+                                const float *cb = &below->clusterBounds[center * 4];
+                                b[0] = std::min(b[0], cb[0]);
+                                b[1] = std::min(b[1], cb[1]);
+                                b[2] = std::max(b[2], cb[2]);
+                                b[3] = std::max(b[3], cb[3]);
+                            }
+                            else
+                            {
+                                b[0] = std::min(b[0], floatBelow(c.pos.x));
+                                b[1] = std::min(b[1], floatBelow(c.pos.y));
+                                b[2] = std::max(b[2], floatAbove(c.pos.x));
+                                b[3] = std::max(b[3], floatAbove(c.pos.y));
+                            }
+                        }
+                    }
+                    clusterBounds = std::move(result);
+                }
+
+                static float floatBelow(const double v)
+                {
+                    const auto f = static_cast<float>(v);
+                    return f > v ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+                }
+
+                static float floatAbove(const double v)
+                {
+                    const auto f = static_cast<float>(v);
+                    return f < v ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+                }
+
+                // the base level is searched with the cluster radius of maxZoom
+                static double baseCell(const Options &options_)
+                {
+                    return options_.radius / (options_.extent * std::pow(2, options_.maxZoom));
+                }
+
+                const property_map *propertiesOf(const std::size_t i) const
+                {
+                    return i < properties.size() ? properties[i].get() : nullptr;
+                }
+
+                property_map propertiesCopy(const std::size_t i) const
+                {
+                    const auto *p = propertiesOf(i);
+                    return p ? *p : property_map{};
+                }
+
+                // keeps the map / reduce properties of a new cluster, empty ones as nullptr
+                static void storeProperties(const Options &options_,
+                                            std::vector<std::unique_ptr<property_map>> &into,
+                                            property_map &&p)
+                {
+                    if (options_.reduce)
+                        into.push_back(p.empty() ? nullptr : std::make_unique<property_map>(std::move(p)));
+                }
+
+                // appends the aggregate row of cluster i to rows
+                template <typename TRows>
+                void copyAggregates(const std::size_t i, const std::size_t stride, TRows &rows) const
+                {
+                    const auto row = aggregates.begin() + static_cast<std::ptrdiff_t>(i * stride);
+                    rows.insert(rows.end(), row, row + static_cast<std::ptrdiff_t>(stride));
+                }
+
+                // Stores c in a free slot (with reuse) or a new one and returns its index. The
+                // properties and aggregate row of the slot are left to the caller.
+                std::uint32_t add(const Cluster &c, const Options &options_, const std::size_t stride, const bool reuse)
+                {
+                    std::uint32_t i;
+                    if (reuse && !freeSlots.empty())
+                    {
+                        i = freeSlots.back();
+                        freeSlots.pop_back();
+                        clusters[i] = c;
+                        dead--;
+                    }
+                    else
+                    {
+                        i = static_cast<std::uint32_t>(clusters.size());
+                        clusters.push_back(c);
+                        aggregates.resize(aggregates.size() + stride);
+                        if (options_.reduce)
+                            properties.emplace_back();
+                    }
+                    touch(i);
+                    return i;
+                }
+
+                // The tree position of record i is out of date, it is looked up in the buffer
+                // instead. Called again whenever its position changes.
+                void touch(const std::uint32_t i)
+                {
+                    if (buffered.size() < clusters.size())
+                        buffered.resize(clusters.size(), 0);
+                    const auto key = cellKey(clusters[i].pos.x, clusters[i].pos.y);
+                    if (!buffered[i])
+                    {
+                        buffered[i] = 1;
+                        buffer.push_back(i);
+                        bufferCells[key].push_back(i);
+                        bufferCellOf.emplace(i, key);
+                        return;
+                    }
+                    auto &filed = bufferCellOf[i];
+                    if (filed == key)
+                        return;
+                    auto &previousCell = bufferCells[filed];
+                    *std::find(previousCell.begin(), previousCell.end(), i) = previousCell.back();
+                    previousCell.pop_back();
+                    bufferCells[key].push_back(i);
+                    filed = key;
+                }
+
+                void setProperties(const std::size_t i, const Options &options_, property_map &&p)
+                {
+                    if (options_.reduce)
+                        properties[i] = p.empty() ? nullptr : std::make_unique<property_map>(std::move(p));
+                }
+
+                double *row(const std::size_t i, const std::size_t stride)
+                {
+                    return aggregates.data() + i * stride;
+                }
+
+                const double *row(const std::size_t i, const std::size_t stride) const
+                {
+                    return aggregates.data() + i * stride;
+                }
+
+                // The level as stored, including the records updates left outside of the tree. Records
+                // are written field by field in their in-memory layout, with zeroed padding.
+                void write(detail::SnapshotWriter &out) const
+                {
+                    out.value(cell);
+                    out.value<std::uint64_t>(clusters.size());
+                    out.align();
+                    out.bytes.reserve(out.bytes.size() + clusters.size() * sizeof(Cluster));
+                    for (const auto &c : clusters)
+                    {
+                        out.value(c.pos.x);
+                        out.value(c.pos.y);
+                        out.value(c.num_points);
+                        out.value(c.id);
+                        out.value(c.parent_id);
+                        out.value(c.expansion_zoom);
+                        out.value<std::uint8_t>(0);
+                        out.value<std::uint16_t>(0);
+                    }
+                    out.array(aggregates);
+                    out.value<std::uint64_t>(properties.size());
+                    for (const auto &p : properties)
+                    {
+                        out.value<std::uint8_t>(p ? 1 : 0);
+                        if (p)
+                            out.properties(*p);
+                    }
+                    std::visit([&](const auto &index)
+                               { index.write(out); },
+                               tree);
+                    out.array(buffer);
+                    out.array(freeSlots);
+                    out.value<std::uint64_t>(dead);
+                    out.array(childOffsets);
+                    out.array(children);
+                    out.array(leafBegin);
+                    out.array(clusterBounds);
+                }
+
+                void read(detail::SnapshotReader &in, const Options &options_, const std::size_t stride)
+                {
+                    static_assert(sizeof(Cluster) == 32 && offsetof(Cluster, parent_id) == 24 &&
+                                      offsetof(Cluster, expansion_zoom) == 28,
+                                  "snapshot records are in the layout of Cluster");
+                    cell = in.value<double>();
+                    in.array(clusters);
+                    const auto size = clusters.size();
+                    in.array(aggregates);
+                    in.expect(aggregates.size() == size * stride);
+                    const auto numProperties = in.value<std::uint64_t>();
+                    in.expect(numProperties == (options_.reduce ? size : 0));
+                    properties.reserve(numProperties);
+                    for (std::uint64_t i = 0; i < numProperties; i++)
+                    {
+                        if (in.value<std::uint8_t>())
+                            properties.push_back(std::make_unique<property_map>(in.properties()));
+                        else
+                            properties.emplace_back();
+                    }
+                    switch (options_.precision)
+                    {
+                    case IndexPrecision::Float:
+                        tree.emplace<1>();
+                        break;
+                    case IndexPrecision::Quantized:
+                        tree.emplace<2>();
+                        break;
+                    default:
+                        tree.emplace<0>();
+                        break;
+                    }
+                    std::visit([&](auto &index)
+                               { index.read(in); },
+                               tree);
+
+                    std::vector<std::uint32_t> touched;
+                    in.array(touched);
+                    in.array(freeSlots);
+                    dead = static_cast<std::size_t>(in.value<std::uint64_t>());
+                    for (const auto i : touched)
+                    {
+                        in.expect(i < size);
+                        touch(i);
+                    }
+                    for (const auto i : freeSlots)
+                        in.expect(i < size);
+                    in.array(childOffsets);
+                    in.array(children);
+                    in.expect(childOffsets.empty() ? children.empty() : childOffsets.size() == size + 1);
+                    in.array(leafBegin);
+                    in.expect(leafBegin.empty() || leafBegin.size() == size);
+                    in.array(clusterBounds);
+                    in.expect(clusterBounds.empty() || clusterBounds.size() == size * 4);
+                    // tree entries and child lists index the records; checking that would read
+                    // every page of a mapped level, which is trusted to be written by serialize()
+                    // instead
+                    in.expect(in.borrows() || (treeIdsBelow(size) && childrenValid()));
+                }
+
+                bool childrenValid() const
+                {
+                    for (std::size_t i = 1; i < childOffsets.size(); i++)
+                    {
+                        if (childOffsets[i] < childOffsets[i - 1])
+                            return false;
+                    }
+                    if (!childOffsets.empty() && (childOffsets[0] != 0 || childOffsets.back() != children.size()))
+                        return false;
+                    return std::all_of(children.begin(), children.end(), [&](const std::uint32_t i)
+                                       { return i < clusters.size(); });
+                }
+
+                // Refills the tree once the buffer outgrows a fraction of the level, so every
+                // refill is paid for by a proportional number of updates.
+                void compact(const Options &options_)
+                {
+                    if (buffer.size() <= std::max(bufferMinSize, clusters.size() / 8))
+                        return;
+                    fillTree(options_, threadCount(options_));
+                    buffer.clear();
+                    buffered.clear();
+                    bufferCells.clear();
+                    bufferCellOf.clear();
+                }
+
+            private:
+                static constexpr std::size_t bufferMinSize = 256;
+
+                // Points outside of the projected world (longitudes beyond +-180) share the cells
+                // on its edges, so records and query boxes land in the same cells.
+                std::uint64_t cellKey(const double x, const double y) const
+                {
+                    constexpr double last = std::numeric_limits<std::uint32_t>::max();
+                    return (std::uint64_t(static_cast<std::uint32_t>(std::clamp(x / cell, 0.0, last))) << 32) |
+                           static_cast<std::uint32_t>(std::clamp(y / cell, 0.0, last));
+                }
+
+                // visits the live buffered records in the cells overlapping a box
+                template <typename TVisitor>
+                bool eachBuffered(const double minX,
+                                  const double minY,
+                                  const double maxX,
+                                  const double maxY,
+                                  const TVisitor &visitor) const
+                {
+                    const auto first = cellKey(minX, minY);
+                    const auto last = cellKey(maxX, maxY);
+                    const std::uint64_t columns = (last >> 32) - (first >> 32) + 1;
+                    const std::uint64_t rows = (last & 0xffffffff) - (first & 0xffffffff) + 1;
+                    if (columns * rows > bufferCells.size())
+                    {
+                        for (const auto id : buffer)
+                        {
+                            if (clusters[id].num_points > 0 && !visitor(id))
+                                return false;
+                        }
+                        return true;
+                    }
+                    for (std::uint64_t column = first >> 32; column <= last >> 32; column++)
+                    {
+                        for (std::uint64_t row = first & 0xffffffff; row <= (last & 0xffffffff); row++)
+                        {
+                            const auto itr = bufferCells.find((column << 32) | row);
+                            if (itr == bufferCells.end())
+                                continue;
+                            for (const auto id : itr->second)
+                            {
+                                if (clusters[id].num_points > 0 && !visitor(id))
+                                    return false;
+                            }
+                        }
+                    }
+                    return true;
+                }
+
+                bool treeIdsBelow(const std::size_t size) const
+                {
+                    return std::visit([&](const auto &index)
+                                      { return index.idsBelow(size); },
+                                      tree);
+                }
+
+                bool inTree(const std::uint32_t id) const
+                {
+                    return clusters[id].num_points > 0 && !(id < buffered.size() && buffered[id]);
+                }
+
+                void fillTree(const Options &options_, const std::size_t threads)
+                {
+                    switch (options_.precision)
+                    {
+                    case IndexPrecision::Float:
+                        tree.emplace<1>();
+                        break;
+                    case IndexPrecision::Quantized:
+                        tree.emplace<2>();
+                        break;
+                    default:
+                        tree.emplace<0>();
+                        break;
+                    }
+                    std::visit([&](auto &index)
+                               { index.fill(clusters.begin(), clusters.end(), threads); },
+                               tree);
+                }
+
+                static std::size_t threadCount(const Options &options_)
+                {
+                    return options_.threads == 0
+                               ? std::max(1u, std::thread::hardware_concurrency())
+                               : options_.threads;
+                }
+
+                // levels smaller than this are not worth the thread overhead
+                static constexpr std::size_t parallelMinClusters = 16384;
+
+                void clusterSequential(Zoom &previous,
+                                       const double r,
+                                       const std::uint8_t zoom,
+                                       const Options &options_,
+                                       const std::size_t previous_clusters_size)
+                {
+                    const detail::Accumulators accumulators(options_.aggregates);
+                    const auto stride = accumulators.size();
+                    // build scratch, released once the level is done
+                    std::vector<std::uint8_t> visited(previous.clusters.size(), 0);
+                    previous.up.assign(previous.clusters.size(), noRecord);
+                    previous.rank.assign(previous.clusters.size(), noRecord);
+
+                    for (std::size_t i = 0; i < previous_clusters_size; i++)
+                    {
+                        auto &p = previous.clusters[i];
+
+                        if (visited[i] || p.num_points == 0)
+                        {
+                            continue;
+                        }
+
+                        visited[i] = true;
+
+                        const auto num_points_origin = p.num_points;
+                        auto num_points = num_points_origin;
+                        auto cluster_size = previous.clusters.size();
+                        // count the number of points in a potential cluster, stopping once there
+                        // are enough (the total is summed up again while merging)
+                        previous.within(p.pos.x, p.pos.y, r, [&](const auto &neighbor_id)
+                                        {
+                    assert(neighbor_id < cluster_size);
+                    const auto &b = previous.clusters[neighbor_id];
+                    // filter out neighbors that are already processed
+                    if (!visited[neighbor_id]) {
+                        num_points += b.num_points;
+                    }
+                    return num_points < options_.minPoints; });
+
+                        auto clusterProperties = previous.propertiesCopy(i);
+                        if (num_points >= options_.minPoints)
+                        { // enough points to form a cluster
+                            point<double> weight = p.pos * double(num_points_origin);
+                            num_points = num_points_origin;
+                            std::uint32_t id = static_cast<std::uint32_t>((i << 5) + (zoom + 1));
+                            const auto slot = static_cast<std::uint32_t>(clusters.size());
+                            const auto row = aggregates.size();
+                            previous.copyAggregates(i, stride, aggregates);
+                            std::uint32_t merged = 0;
+
+                            // find all nearby points
+                            previous.within(p.pos.x, p.pos.y, r, [&](const auto &neighbor_id)
+                                            {
+                        assert(neighbor_id < cluster_size);
+                        auto &b = previous.clusters[neighbor_id];
+
+                        if (neighbor_id == i) {
+                            previous.rank[i] = merged++;
+                            return;
+                        }
+                        // filter out neighbors that are already processed
+                        if (visited[neighbor_id]) {
+                            return;
+                        }
+
+                        visited[neighbor_id] = true;
+                        b.parent_id = id;
+                        previous.up[neighbor_id] = slot;
+                        previous.rank[neighbor_id] = merged++;
+                        num_points += b.num_points;
+
+                        // accumulate coordinates for calculating weighted center
+                        weight += b.pos * double(b.num_points);
+
+                        if (options_.reduce && previous.propertiesOf(neighbor_id)) {
+                            // apply reduce function to update clusterProperites
+                            options_.reduce(clusterProperties, *previous.propertiesOf(neighbor_id));
+                        }
+                        if (stride > 0) {
+                            accumulators.merge(&aggregates[row], &previous.aggregates[neighbor_id * stride]);
+                        } });
+                            p.parent_id = id;
+                            previous.up[i] = slot;
+                            if (previous.rank[i] == noRecord)
+                                previous.rank[i] = merged;
+                            clusters.emplace_back(weight / double(num_points), num_points, id);
+                            storeProperties(options_, properties, std::move(clusterProperties));
+                        }
+                        else
+                        {
+                            previous.up[i] = static_cast<std::uint32_t>(clusters.size());
+                            clusters.emplace_back(p.pos, 1, p.id);
+                            storeProperties(options_, properties, std::move(clusterProperties));
+                            previous.copyAggregates(i, stride, aggregates);
+                            if (num_points > 1)
+                            {
+                                previous.within(p.pos.x, p.pos.y, r, [&](const auto &neighbor_id)
+                                                {
+                            assert(neighbor_id < cluster_size);
+                            auto &b = previous.clusters[neighbor_id];
+                            // filter out neighbors that are already processed
+                            if (visited[neighbor_id]) {
+                                return;
+                            }
+                            visited[neighbor_id] = true;
+                            previous.up[neighbor_id] = static_cast<std::uint32_t>(clusters.size());
+                            clusters.emplace_back(b.pos, 1, b.id);
+                            storeProperties(options_, properties, previous.propertiesCopy(neighbor_id));
+                            previous.copyAggregates(neighbor_id, stride, aggregates); });
+                            }
+                        }
+                    }
+                }
+
+                // Produces exactly the same clusters, in the same order, as clusterSequential.
+                //
+                // The greedy pass turns a point into a cluster center iff no center with a lower
+                // index lies within r, and every other point joins the lowest-index center within
+                // r. So a point only depends on its lower-index neighbors: the level is split into
+                // vertical strips that are swept concurrently in index order, and points waiting on
+                // an undecided neighbor from another strip are retried in the next round. Once all
+                // centers are known, clusters are emitted per index range and concatenated.
+                void clusterParallel(Zoom &previous,
+                                     const double r,
+                                     const std::uint8_t zoom,
+                                     const Options &options_,
+                                     const std::size_t previous_clusters_size,
+                                     const std::size_t threads)
+                {
+                    enum : std::uint8_t
+                    {
+                        undecided,
+                        center,
+                        member
+                    };
+                    constexpr auto no_owner = std::numeric_limits<std::uint32_t>::max();
+
+                    const auto &points = previous.clusters;
+                    const auto cluster_size = points.size();
+
+                    // split by x into strips holding a similar number of points
+                    std::vector<double> splits;
+                    {
+                        const std::size_t step = std::max<std::size_t>(1, previous_clusters_size / 4096);
+                        std::vector<double> sample;
+                        for (std::size_t i = 0; i < previous_clusters_size; i += step)
+                            sample.push_back(points[i].pos.x);
+                        std::sort(sample.begin(), sample.end());
+                        for (std::size_t t = 1; t < threads; t++)
+                            splits.push_back(sample[t * sample.size() / threads]);
+                    }
+                    std::vector<std::vector<std::uint32_t>> strips(threads);
+                    for (std::uint32_t i = 0; i < previous_clusters_size; i++)
+                    {
+                        const auto strip = std::upper_bound(splits.begin(), splits.end(), points[i].pos.x) - splits.begin();
+                        strips[strip].push_back(i);
+                    }
+
+                    // decide which points become cluster centers
+                    std::unique_ptr<std::atomic<std::uint8_t>[]> state(
+                        new std::atomic<std::uint8_t>[previous_clusters_size]);
+                    for (std::size_t i = 0; i < previous_clusters_size; i++)
+                        state[i].store(undecided, std::memory_order_relaxed);
+
+                    bool pending = true;
+                    while (pending)
+                    {
+                        detail::parallelFor(threads, [&](const std::size_t t)
+                                            {
+                        auto &strip = strips[t];
+                        std::size_t kept = 0;
+                        for (const auto i : strip) {
+                            const auto &p = points[i];
+                            bool claimed = false;
+                            bool blocked = false;
+                            previous.within(p.pos.x, p.pos.y, r, [&](const auto &neighbor_id) {
+                                if (neighbor_id >= i) {
+                                    return true;
+                                }
+                                const auto s = state[neighbor_id].load(std::memory_order_acquire);
+                                if (s == center) {
+                                    // a claimed point is a member whatever its other neighbors are
+                                    claimed = true;
+                                    return false;
+                                }
+                                if (s == undecided) {
+                                    blocked = true;
+                                }
+                                return true; });
+                            if (claimed) {
+                                state[i].store(member, std::memory_order_release);
+                            } else if (!blocked) {
+                                state[i].store(center, std::memory_order_release);
+                            } else {
+                                // retry next round
+                                strip[kept++] = i;
+                            }
+                        }
+                        strip.resize(kept); });
+
+                        pending = std::any_of(strips.begin(), strips.end(), [](const auto &strip)
+                                              { return !strip.empty(); });
+                    }
+
+                    const auto isCenter = [&](const std::size_t i)
+                    {
+                        return i < previous_clusters_size &&
+                               state[i].load(std::memory_order_relaxed) == center;
+                    };
+
+                    // assign every point to the lowest-index center within r
+                    std::vector<std::uint32_t> owner(cluster_size, no_owner);
+                    detail::parallelFor(threads, [&](const std::size_t t)
+                                        {
+                    const auto begin = cluster_size * t / threads;
+                    const auto end = cluster_size * (t + 1) / threads;
+                    for (auto i = begin; i < end; i++) {
+                        if (isCenter(i)) {
+                            owner[i] = static_cast<std::uint32_t>(i);
+                            continue;
+                        }
+                        const auto &p = points[i];
+                        std::uint32_t best = no_owner;
+                        previous.within(p.pos.x, p.pos.y, r, [&](const auto &neighbor_id) {
+                            if (neighbor_id < best && isCenter(neighbor_id)) {
+                                best = neighbor_id;
+                            } });
+                        owner[i] = best;
+                    } });
+
+                    // emit clusters in center order, with up indexing the chunk of the center until
+                    // the chunks are concatenated
+                    previous.up.assign(cluster_size, noRecord);
+                    previous.rank.assign(cluster_size, noRecord);
+                    const detail::Accumulators accumulators(options_.aggregates);
+                    const auto stride = accumulators.size();
+                    std::vector<std::vector<Cluster>> chunks(threads);
+                    std::vector<std::vector<double>> chunkAggregates(threads);
+                    std::vector<std::vector<std::unique_ptr<property_map>>> chunkProperties(threads);
+                    detail::parallelFor(threads, [&](const std::size_t t)
+                                        {
+                    auto &out = chunks[t];
+                    auto &outAggregates = chunkAggregates[t];
+                    auto &outProperties = chunkProperties[t];
+                    std::vector<std::uint32_t> members;
+                    const auto begin = previous_clusters_size * t / threads;
+                    const auto end = previous_clusters_size * (t + 1) / threads;
+                    for (auto i = begin; i < end; i++) {
+                        if (!isCenter(i)) {
+                            continue;
+                        }
+                        auto &p = previous.clusters[i];
+
+                        const auto num_points_origin = p.num_points;
+                        auto num_points = num_points_origin;
+                        members.clear();
+                        // where the center itself comes among its members
+                        auto centerRank = noRecord;
+                        previous.within(p.pos.x, p.pos.y, r, [&](const auto &neighbor_id) {
+                            assert(neighbor_id < cluster_size);
+                            if (neighbor_id == i) {
+                                centerRank = static_cast<std::uint32_t>(members.size());
+                            } else if (owner[neighbor_id] == i) {
+                                members.push_back(neighbor_id);
+                                num_points += points[neighbor_id].num_points;
+                            } });
+
+                        auto clusterProperties = previous.propertiesCopy(i);
+                        if (num_points >= options_.minPoints) {
+                            point<double> weight = p.pos * double(num_points_origin);
+                            std::uint32_t id = static_cast<std::uint32_t>((i << 5) + (zoom + 1));
+                            const auto slot = static_cast<std::uint32_t>(out.size());
+                            const auto row = outAggregates.size();
+                            previous.copyAggregates(i, stride, outAggregates);
+                            centerRank = std::min(centerRank, static_cast<std::uint32_t>(members.size()));
+                            std::uint32_t merged = 0;
+                            for (const auto neighbor_id : members) {
+                                auto &b = previous.clusters[neighbor_id];
+                                b.parent_id = id;
+                                previous.up[neighbor_id] = slot;
+                                const auto k = merged++;
+                                previous.rank[neighbor_id] = k < centerRank ? k : k + 1;
+                                weight += b.pos * double(b.num_points);
+                                if (options_.reduce && previous.propertiesOf(neighbor_id)) {
+                                    options_.reduce(clusterProperties, *previous.propertiesOf(neighbor_id));
+                                }
+                                if (stride > 0) {
+                                    accumulators.merge(&outAggregates[row], &previous.aggregates[neighbor_id * stride]);
+                                }
+                            }
+                            p.parent_id = id;
+                            previous.up[i] = slot;
+                            previous.rank[i] = centerRank;
+                            out.emplace_back(weight / double(num_points), num_points, id);
+                            storeProperties(options_, outProperties, std::move(clusterProperties));
+                        } else {
+                            previous.up[i] = static_cast<std::uint32_t>(out.size());
+                            out.emplace_back(p.pos, 1, p.id);
+                            storeProperties(options_, outProperties, std::move(clusterProperties));
+                            previous.copyAggregates(i, stride, outAggregates);
+                            for (const auto neighbor_id : members) {
+                                const auto &b = previous.clusters[neighbor_id];
+                                previous.up[neighbor_id] = static_cast<std::uint32_t>(out.size());
+                                out.emplace_back(b.pos, 1, b.id);
+                                storeProperties(options_, outProperties, previous.propertiesCopy(neighbor_id));
+                                previous.copyAggregates(neighbor_id, stride, outAggregates);
+                            }
+                        }
+                    } });
+
+                    std::size_t total = 0;
+                    std::vector<std::uint32_t> chunkStart;
+                    for (const auto &chunk : chunks)
+                    {
+                        chunkStart.push_back(static_cast<std::uint32_t>(total));
+                        total += chunk.size();
+                    }
+                    // every record was emitted by the chunk its center is in
+                    detail::parallelFor(threads, [&](const std::size_t t)
+                                        {
+                    const auto begin = cluster_size * t / threads;
+                    const auto end = cluster_size * (t + 1) / threads;
+                    for (auto i = begin; i < end; i++) {
+                        if (previous.up[i] == noRecord) {
+                            continue;
+                        }
+                        const std::size_t c = isCenter(i) ? i : owner[i];
+                        auto chunk = c * threads / previous_clusters_size;
+                        while (previous_clusters_size * chunk / threads > c)
+                            chunk--;
+                        while (previous_clusters_size * (chunk + 1) / threads <= c)
+                            chunk++;
+                        previous.up[i] += chunkStart[chunk];
+                    } });
+                    clusters.reserve(total);
+                    for (auto &chunk : chunks)
+                        std::move(chunk.begin(), chunk.end(), std::back_inserter(clusters));
+                    aggregates.reserve(total * stride);
+                    for (const auto &chunk : chunkAggregates)
+                        aggregates.insert(aggregates.end(), chunk.begin(), chunk.end());
+                    if (options_.reduce)
+                    {
+                        properties.reserve(total);
+                        for (auto &chunk : chunkProperties)
+                            std::move(chunk.begin(), chunk.end(), std::back_inserter(properties));
+                    }
+                }
+            };
+
+            std::unordered_map<std::uint8_t, Zoom> zooms;
+            const detail::Accumulators accumulators;
+            mutable detail::TileCache tileCache;
+            // points loaded without features, see the longitude / latitude constructor
+            kdbush::detail::Array<double> lngLat;
+            kdbush::detail::Array<std::uint32_t> pointIds;
+            // points in depth first order of the cluster hierarchy, see indexLeaves()
+            kdbush::detail::Array<std::uint32_t> leafOrder;
+            std::atomic<bool> leavesOrdered{false};
+            // whether Cluster::expansion_zoom holds, cleared by the first update
+            std::atomic<bool> expansionZoomsRecorded{true};
+            // whether Zoom::clusterBounds are recorded, cleared by the first update
+            std::atomic<bool> boundsRecorded{true};
+#ifdef SUPERCLUSTER_MMAP
+            // the snapshot the arrays above and the zoom levels borrow from, see mapSnapshot()
+            std::unique_ptr<detail::MappedFile> mapped;
+#endif
+
+            TileFeatures
+            makeTile(const std::uint8_t z, const std::uint32_t x_, const std::uint32_t y) const
+            {
+                TileFeatures result;
+
+                eachTileCluster(z, x_, y, [&, this](const Cluster &c, const TilePoint &point)
+                                {
+                    if (c.num_points == 1 && !lngLat.empty())
+                    {
+                        auto featureId = options.generateId ? identifier{static_cast<std::uint64_t>(c.id)} : pointId(c.id);
+                        result.emplace_back(point, property_map{}, std::move(featureId));
+                    }
+                    else if (c.num_points == 1)
+                    {
+                        const auto &original_feature = this->features[c.id];
+                        // Generate feature id if options.generateId is set.
+                        auto featureId = options.generateId ? identifier{static_cast<std::uint64_t>(c.id)} : original_feature.id;
+                        result.emplace_back(point, original_feature.properties, std::move(featureId));
+                    }
+                    else
+                    {
+                        result.emplace_back(point, clusterProperties(c),
+                                            identifier(static_cast<std::uint64_t>(c.id)));
+                    } });
+
+                return result;
+            }
+
+            void clusterZooms()
+            {
+#ifdef DEBUG_TIMER
+                Timer timer;
+#endif
+                tileCache.clear();
+                if (options.onZoomIndexed)
+                    options.onZoomIndexed(options.maxZoom + 1, zooms[options.maxZoom + 1].clusters.size());
+                for (int z = options.maxZoom; z >= options.minZoom; z--)
+                {
+                    // lazy levels are only reserved here, so building them later doesn't change
+                    // the map that concurrent queries look levels up in
+                    if (options.lazyZooms)
+                    {
+                        zooms.emplace(z, Zoom());
+                        continue;
+                    }
+                    if (options.cancelled && options.cancelled())
+                        throw BuildCancelled();
+                    zooms.emplace(z, Zoom());
+                    clusterZoom(static_cast<std::uint8_t>(z));
+#ifdef DEBUG_TIMER
+                    timer(std::to_string(zooms[z].clusters.size()) + " clusters");
+#endif
+                }
+                if (!options.lazyZooms)
+                    indexLeaves();
+                builtZoom.store(options.lazyZooms ? options.maxZoom + 1 : options.minZoom, std::memory_order_release);
+            }
+
+            // Orders the points depth first along the cluster hierarchy, so the leaves of every
+            // record are a range of leafOrder starting at its leafBegin, once all zoom levels are
+            // built. Levels restored from a snapshot without the ranges or changed by updates have
+            // no up links; getLeaves then walks the hierarchy instead.
+            void indexLeaves()
+            {
+                const int top = options.minZoom;
+                bool ordered = top <= options.maxZoom;
+                for (int z = top + 1; ordered && z <= options.maxZoom + 1; z++)
+                {
+                    const auto &zoom = zooms.find(z)->second;
+                    ordered = zoom.up.size() == zoom.clusters.size() &&
+                              zoom.childOffsets.size() == zoom.clusters.size() + 1;
+                }
+                if (ordered)
+                {
+                    auto &first = zooms.find(top)->second;
+                    std::vector<std::uint32_t> begins(first.clusters.size());
+                    std::uint32_t cursor = 0;
+                    for (std::size_t k = 0; k < begins.size(); k++)
+                    {
+                        begins[k] = cursor;
+                        cursor += first.clusters[k].num_points;
+                    }
+                    first.leafBegin = std::move(begins);
+
+                    // the children of a cluster take up its range in the order of its child list,
+                    // a copied record all of it
+                    for (int z = top + 1; ordered && z <= options.maxZoom + 1; z++)
+                    {
+                        const auto &above = zooms.find(z - 1)->second;
+                        auto &zoom = zooms.find(z)->second;
+                        std::vector<std::uint32_t> next(above.leafBegin.begin(), above.leafBegin.end());
+                        begins.assign(zoom.clusters.size(), 0);
+                        const auto place = [&](const std::uint32_t q)
+                        {
+                            const auto k = zoom.up[q];
+                            ordered = ordered && k < next.size();
+                            if (ordered)
+                            {
+                                begins[q] = next[k];
+                                next[k] += zoom.clusters[q].num_points;
+                            }
+                        };
+                        for (const auto q : zoom.children)
+                            place(q);
+                        for (std::uint32_t q = 0; ordered && q < begins.size(); q++)
+                        {
+                            const auto &c = zoom.clusters[q];
+                            if (c.num_points > 0 && c.parent_id == 0)
+                                place(q);
+                        }
+                        for (std::size_t k = 0; ordered && k < next.size(); k++)
+                            ordered = next[k] == above.leafBegin[k] + above.clusters[k].num_points;
+                        zoom.leafBegin = std::move(begins);
+                    }
+
+                    if (ordered)
+                    {
+                        const auto &base = zooms.find(options.maxZoom + 1)->second;
+                        std::vector<std::uint32_t> order(cursor);
+                        for (std::uint32_t q = 0; q < base.clusters.size(); q++)
+                        {
+                            if (base.clusters[q].num_points > 0)
+                                order[base.leafBegin[q]] = q;
+                        }
+                        leafOrder = std::move(order);
+                    }
+                }
+                for (auto &entry : zooms)
+                {
+                    if (ordered)
+                        entry.second.up = std::vector<std::uint32_t>();
+                    else
+                        entry.second.dropLeaves();
+                }
+                leavesOrdered.store(ordered, std::memory_order_release);
+            }
+
+            // every leaf range lies within leafOrder, which holds each point once
+            // Whether the records of the zoom levels from built up index what they refer to: the
+            // points (single points), the center record of the level above (clusters, whose id
+            // also names the level they are stored on, see appendClusterProperties) and a cluster
+            // of the level below (parent ids). Removed records must be the ones counted as dead,
+            // and free slots hold removed records only.
+            bool recordsValid(const int built, const std::size_t points) const
+            {
+                const int base = options.maxZoom + 1;
+                for (int z = base; z >= built; z--)
+                {
+                    const auto &zoom = zooms.find(z)->second;
+                    const auto above = z < base ? zooms.find(z + 1)->second.clusters.size() : 0;
+                    std::unordered_set<std::uint32_t> parents;
+                    if (z > built)
+                    {
+                        for (const auto &c : zooms.find(z - 1)->second.clusters)
+                        {
+                            if (c.num_points > 1 || (c.num_points == 1 && options.minPoints <= 1))
+                                parents.insert(c.id);
+                        }
+                    }
+                    std::size_t dead = 0;
+                    for (const auto &c : zoom.clusters)
+                    {
+                        const bool point = c.id < points;
+                        const bool cluster = z < base && c.id % 32 == std::uint32_t(z + 1) && (c.id >> 5) < above;
+                        if (c.num_points == 0)
+                        {
+                            // removed records keep their last id, they are never visited
+                            dead++;
+                            if (!point && !cluster)
+                                return false;
+                            continue;
+                        }
+                        if (c.num_points > points)
+                            return false;
+                        // a single point clusters alone with minPoints 1
+                        if (c.num_points == 1 ? !(point || (cluster && options.minPoints <= 1)) : !cluster)
+                            return false;
+                        if (c.parent_id != 0 && !parents.count(c.parent_id))
+                            return false;
+                    }
+                    if (dead != zoom.dead)
+                        return false;
+                    std::unordered_set<std::uint32_t> free;
+                    for (const auto i : zoom.freeSlots)
+                    {
+                        if (zoom.clusters[i].num_points != 0 || !free.insert(i).second)
+                            return false;
+                    }
+                }
+                return true;
             }
 
-            GeoJSONFeatures getChildren(const std::uint32_t cluster_id) const
+            bool leavesValid() const
             {
-                GeoJSONFeatures children;
-                eachChild(cluster_id,
-                          [&, this](const auto &c)
-                          { children.push_back(this->clusterToGeoJSON(c)); });
-                return children;
+                std::vector<std::uint8_t> seen(zooms.find(options.maxZoom + 1)->second.clusters.size(), 0);
+                for (const auto q : leafOrder)
+                {
+                    if (q >= seen.size() || seen[q])
+                        return false;
+                    seen[q] = 1;
+                }
+                for (const auto &entry : zooms)
+                {
+                    const auto &zoom = entry.second;
+                    for (std::size_t k = 0; k < zoom.leafBegin.size(); k++)
+                    {
+                        if (std::uint64_t(zoom.leafBegin[k]) + zoom.clusters[k].num_points > leafOrder.size())
+                            return false;
+                    }
+                }
+                return true;
             }
 
-            GeoJSONFeatures getLeaves(const std::uint32_t cluster_id,
-                                      const std::uint32_t limit = 10,
-                                      const std::uint32_t offset = 0) const
+            void dropLeaves()
             {
-                GeoJSONFeatures leaves;
-                std::uint32_t skipped = 0;
-                std::uint32_t limit_ = limit;
-                eachLeaf(cluster_id, limit_, offset, skipped,
-                         [&, this](const auto &c)
-                         { leaves.push_back(this->clusterToGeoJSON(c)); });
-                return leaves;
+                leavesOrdered.store(false, std::memory_order_release);
+                leafOrder.clear();
+                for (auto &entry : zooms)
+                    entry.second.dropLeaves();
             }
 
-            std::uint8_t getClusterExpansionZoom(std::uint32_t cluster_id) const
+            // clusters the points of the previous zoom level into the reserved level z
+            void clusterZoom(const std::uint8_t z)
             {
-                auto cluster_zoom = (cluster_id % 32) - 1;
-                while (cluster_zoom <= options.maxZoom)
+                const double r = options.radius / (options.extent * std::pow(2, z));
+                auto &zoom = zooms.find(z)->second;
+                auto &previous = zooms.find(z + 1)->second;
+                zoom.cluster(previous, r, z, options);
+                // levels built after an update would merge the stale bounds of the level below
+                if (boundsRecorded.load(std::memory_order_relaxed))
                 {
-                    std::uint32_t num_children = 0;
-
-                    eachChild(cluster_id, [&](const auto &c)
-                              {
-                num_children++;
-                cluster_id = c.id; });
-
-                    cluster_zoom++;
-
-                    if (num_children != 1)
-                        break;
+                    const auto below = zooms.find(z + 2);
+                    previous.indexBounds(below != zooms.end() ? &below->second : nullptr);
                 }
-                return cluster_zoom;
+                if (options.onZoomIndexed)
+                    options.onZoomIndexed(z, zoom.clusters.size());
             }
 
-        private:
-            struct Zoom
+            // Records of a zoom level changed by an update, handed on to the level above: records
+            // added, records removed or changed in place, and records that only moved, the latter
+            // two with their state before the update.
+            struct LevelChanges
             {
-                kdbush::KDBush<Cluster, std::uint32_t> tree;
-                std::vector<Cluster> clusters;
+                std::vector<std::uint32_t> added;
+                std::vector<std::pair<std::uint32_t, Cluster>> changed;
+                std::vector<std::pair<std::uint32_t, Cluster>> moved;
 
-                Zoom() = default;
+                bool empty() const
+                {
+                    return added.empty() && changed.empty() && moved.empty();
+                }
 
-                Zoom(const GeoJSONFeatures &features_, const Options &options_)
+                // Adds the changes of a later update. Records keep their state before the first
+                // one, and records added since the level above was updated stay added, unless
+                // their slot was added again after being removed.
+                void merge(LevelChanges &&later)
                 {
-                    // generate a cluster object for each point
-                    std::uint32_t i = 0;
-                    clusters.reserve(features_.size());
-                    for (const auto &f : features_)
+                    if (empty())
                     {
-                        if (options_.reduce)
+                        *this = std::move(later);
+                        return;
+                    }
+                    std::unordered_set<std::uint32_t> fresh(added.begin(), added.end());
+                    std::unordered_map<std::uint32_t, std::size_t> changedAt, movedAt;
+                    for (std::size_t k = 0; k < changed.size(); k++)
+                        changedAt.emplace(changed[k].first, k);
+                    for (std::size_t k = 0; k < moved.size(); k++)
+                        movedAt.emplace(moved[k].first, k);
+
+                    constexpr auto gone = std::numeric_limits<std::uint32_t>::max();
+                    for (auto &entry : later.changed)
+                    {
+                        if (fresh.count(entry.first) || changedAt.count(entry.first))
+                            continue;
+                        const auto itr = movedAt.find(entry.first);
+                        if (itr != movedAt.end())
                         {
-                            const auto clusterProperties = options_.map(f.properties);
-                            clusters.emplace_back(project(f.geometry.get<GeoJSONPoint>()), 1, i++,
-                                                  clusterProperties);
+                            changed.emplace_back(std::move(moved[itr->second]));
+                            moved[itr->second].first = gone;
+                            movedAt.erase(itr);
                         }
                         else
                         {
-                            clusters.emplace_back(project(f.geometry.get<GeoJSONPoint>()), 1, i++);
+                            changed.emplace_back(std::move(entry));
                         }
+                        changedAt.emplace(changed.back().first, changed.size() - 1);
+                    }
+                    for (auto &entry : later.moved)
+                    {
+                        if (!fresh.count(entry.first) && !changedAt.count(entry.first) && !movedAt.count(entry.first))
+                            moved.emplace_back(std::move(entry));
+                    }
+                    moved.erase(std::remove_if(moved.begin(), moved.end(), [](const auto &entry)
+                                               { return entry.first == gone; }),
+                                moved.end());
+                    for (const auto i : later.added)
+                    {
+                        if (fresh.insert(i).second)
+                            added.push_back(i);
                     }
-                    tree.fill(clusters);
+
+                    const auto byIndex = [](const auto &a, const auto &b)
+                    { return a.first < b.first; };
+                    std::sort(added.begin(), added.end());
+                    std::sort(changed.begin(), changed.end(), byIndex);
+                    std::sort(moved.begin(), moved.end(), byIndex);
                 }
+            };
+
+            // Changes of every zoom level not applied to the level above it yet, by the zoom level
+            // they apply to, and the highest such level (-1 if there is none). settle() applies
+            // them for the levels a query reads.
+            mutable std::vector<LevelChanges> deferred;
+            mutable std::atomic<int> staleZoom{-1};
+            // lowest zoom level built, levels below it are built by settle() (Options::lazyZooms)
+            mutable std::atomic<int> builtZoom{0};
+            mutable std::mutex settleMutex;
 
-                Zoom(Zoom &previous, const double r, const std::uint8_t zoom, const Options &options_)
+            // point ids of an index loaded with coordinates and ids, built by the first update
+            std::unordered_map<std::uint32_t, std::uint32_t> pointIndexById;
+
+            std::uint32_t pointIndex(const std::uint32_t id)
+            {
+                if (pointIds.empty())
+                    return id;
+                if (pointIndexById.empty())
                 {
+                    for (std::uint32_t i = 0; i < pointIds.size(); i++)
+                        pointIndexById.emplace(pointIds[i], i);
+                }
+                const auto itr = pointIndexById.find(id);
+                return itr == pointIndexById.end() ? std::numeric_limits<std::uint32_t>::max() : itr->second;
+            }
 
-                    // The zoom parameter is restricted to [minZoom, maxZoom] by caller
-                    assert(((zoom + 1) & 0b11111) == (zoom + 1));
+            // appends point i to the base level, which is indexed by point
+            void addPoint(Zoom &base, const std::uint32_t i, const point<double> &pos, const property_map &properties)
+            {
+                const auto stride = accumulators.size();
+                base.add(Cluster(pos, 1, i), options, stride, false);
+                if (options.reduce)
+                    base.setProperties(i, options, options.map(properties));
+                if (stride > 0)
+                {
+                    std::vector<double> row;
+                    accumulators.append(row, properties);
+                    std::copy(row.begin(), row.end(), base.row(i, stride));
+                }
+            }
 
-                    // Since point index is encoded in the upper 27 bits, clamp the count of clusters
-                    const auto previous_clusters_size = std::min(
-                        previous.clusters.size(), static_cast<std::vector<Cluster>::size_type>(0x7ffffff));
+            // Defers the changes of the base level to the zoom levels above it.
+            void update(LevelChanges changes)
+            {
+                tileCache.clear();
+                zooms[options.maxZoom + 1].compact(options);
+                if (changes.empty())
+                    return;
+                dropLeaves();
+                expansionZoomsRecorded.store(false, std::memory_order_release);
+                boundsRecorded.store(false, std::memory_order_release);
+                for (auto &entry : zooms)
+                    entry.second.clusterBounds.clear();
+                // levels not built yet are built from the updated level above them
+                if (builtZoom.load(std::memory_order_relaxed) > options.maxZoom)
+                    return;
+                if (deferred.empty())
+                    deferred.resize(options.maxZoom + 1);
+                deferred[options.maxZoom].merge(std::move(changes));
+                staleZoom.store(options.maxZoom, std::memory_order_release);
+            }
 
-                    for (std::size_t i = 0; i < previous_clusters_size; i++)
-                    {
-                        auto &p = previous.clusters[i];
+            // Applies the deferred changes of zoom levels z and above and builds the ones of them
+            // not built yet. Queries call this before reading a level, so it changes the index
+            // from const methods; concurrent queries are serialized here, and a settled level is
+            // only read from then on.
+            void settle(const std::uint8_t z) const
+            {
+                if (staleZoom.load(std::memory_order_acquire) < int(z) &&
+                    builtZoom.load(std::memory_order_acquire) <= int(z))
+                    return;
+                std::lock_guard<std::mutex> lock(settleMutex);
+                auto &self = const_cast<Supercluster &>(*this);
+                const int built = builtZoom.load(std::memory_order_relaxed);
+                int zz = staleZoom.load(std::memory_order_relaxed);
+                for (; zz >= std::max<int>(z, options.minZoom); zz--)
+                {
+                    auto changes = std::move(self.deferred[zz]);
+                    self.deferred[zz] = LevelChanges();
+                    if (changes.empty())
+                        continue;
+                    auto result = self.updateZoom(self.zooms.find(zz + 1)->second, self.zooms.find(zz)->second,
+                                                  static_cast<std::uint8_t>(zz), changes);
+                    if (zz > std::max<int>(built, options.minZoom))
+                        self.deferred[zz - 1].merge(std::move(result));
+                }
+                while (zz >= options.minZoom && deferred[zz].empty())
+                    zz--;
+                staleZoom.store(zz >= options.minZoom ? zz : -1, std::memory_order_release);
 
-                        if (p.visited)
-                        {
-                            continue;
+                for (int b = built - 1; b >= std::max<int>(z, options.minZoom); b--)
+                {
+                    self.clusterZoom(static_cast<std::uint8_t>(b));
+                    if (b == options.minZoom)
+                        self.indexLeaves();
+                    builtZoom.store(b, std::memory_order_release);
+                }
+            }
+
+            // Reclusters the neighborhoods of the previous level records in `changes` on zoom
+            // level z and returns the records of z that changed in turn. The clusters keep the
+            // invariants of a full build: every previous record is either a single point copied to
+            // z or a member of exactly one cluster, within r of the member the cluster is centered
+            // on (which eachChild relies on).
+            LevelChanges updateZoom(Zoom &previous,
+                                    Zoom &zoom,
+                                    const std::uint8_t z,
+                                    const LevelChanges &changes)
+            {
+                const double r = options.radius / (options.extent * std::pow(2, z));
+                const double r2 = r * r;
+                const auto stride = accumulators.size();
+                // parent ids of previous records change from here on
+                previous.dropChildren();
+                const auto sqDist = [](const point<double> &a, const point<double> &b)
+                {
+                    const double dx = a.x - b.x;
+                    const double dy = a.y - b.y;
+                    return dx * dx + dy * dy;
+                };
+
+                // records of z as they were before this update, the ones of them changed other
+                // than by moving, and the ones added by the update
+                std::unordered_map<std::uint32_t, Cluster> before;
+                std::unordered_set<std::uint32_t> reshaped;
+                std::unordered_set<std::uint32_t> appended;
+                // removed slots, only reused by the next update
+                std::vector<std::uint32_t> released;
+                // callers moving the record touch() it once it is in place
+                const auto change = [&](const std::uint32_t i, const bool moveOnly = false)
+                {
+                    if (!appended.count(i))
+                        before.emplace(i, zoom.clusters[i]);
+                    if (!moveOnly)
+                        reshaped.insert(i);
+                };
+                const auto kill = [&](const std::uint32_t i)
+                {
+                    change(i);
+                    zoom.clusters[i].num_points = 0;
+                    zoom.setProperties(i, options, property_map{});
+                    zoom.dead++;
+                    released.push_back(i);
+                };
+
+                // the record of cluster `id` on z, its position is within r of its center's
+                // position at the time it was last computed
+                const auto findCluster = [&](const std::uint32_t id, const point<double> &near)
+                {
+                    auto slot = std::numeric_limits<std::uint32_t>::max();
+                    zoom.within(near.x, near.y, r * (1 + 1e-9), [&](const std::uint32_t i)
+                                {
+                        const auto &c = zoom.clusters[i];
+                        if (c.num_points > 1 && c.id == id) {
+                            slot = i;
+                            return false;
+                        }
+                        return true; });
+                    return slot;
+                };
+                // the copy of single point p on z, at the same position
+                const auto findPoint = [&](const Cluster &p)
+                {
+                    auto slot = std::numeric_limits<std::uint32_t>::max();
+                    zoom.range(p.pos.x, p.pos.y, p.pos.x, p.pos.y, [&](const std::uint32_t i)
+                               {
+                        const auto &c = zoom.clusters[i];
+                        if (c.num_points == 1 && c.id == p.id) {
+                            slot = i;
+                            return false;
                         }
+                        return true; });
+                    return slot;
+                };
+                const auto killPoint = [&](const Cluster &p)
+                {
+                    const auto slot = findPoint(p);
+                    if (slot != std::numeric_limits<std::uint32_t>::max())
+                        kill(slot);
+                };
+                // copies of moved single points, kept to be moved along if they stay single
+                std::unordered_map<std::uint32_t, std::uint32_t> copies;
+                const auto killCopy = [&](const std::uint32_t i)
+                {
+                    const auto itr = copies.find(i);
+                    if (itr == copies.end())
+                        return false;
+                    kill(itr->second);
+                    copies.erase(itr);
+                    return true;
+                };
 
-                        p.visited = true;
+                std::unordered_map<std::uint32_t, const Cluster *> previousBefore;
+                for (const auto &entry : changes.changed)
+                    previousBefore.emplace(entry.first, &entry.second);
+                for (const auto &entry : changes.moved)
+                    previousBefore.emplace(entry.first, &entry.second);
+
+                // previous records to cluster again, in index order as in a full build
+                std::set<std::uint32_t> pending(changes.added.begin(), changes.added.end());
+                // clusters of z to compute again from their members, by id, true to dissolve them
+                std::map<std::uint32_t, bool> dirty;
+                // clusters of z whose members only moved, by id, with the sum of the moves
+                // weighted by the points moved
+                std::unordered_map<std::uint32_t, point<double>> shifts;
+
+                const auto changed = [&](const std::uint32_t i, const Cluster &old, const bool onlyMoved)
+                {
+                    auto &e = previous.clusters[i];
+                    // the slot of a removed record may hold one added since
+                    const bool alive = e.num_points > 0 &&
+                                       !std::binary_search(changes.added.begin(), changes.added.end(), i);
 
-                        const auto num_points_origin = p.num_points;
-                        auto num_points = num_points_origin;
-                        auto cluster_size = previous.clusters.size();
-                        // count the number of points in a potential cluster
-                        previous.tree.within(p.pos.x, p.pos.y, r, [&](const auto &neighbor_id)
-                                             {
-                    assert(neighbor_id < cluster_size);
-                    const auto &b = previous.clusters[neighbor_id];
-                    // filter out neighbors that are already processed
-                    if (!b.visited) {
-                        num_points += b.num_points;
-                    } });
+                    if (old.parent_id == 0)
+                    {
+                        // a single point, copied to z
+                        const auto slot = old.num_points == 1 ? findPoint(old) : std::numeric_limits<std::uint32_t>::max();
+                        if (alive && slot != std::numeric_limits<std::uint32_t>::max())
+                            copies.emplace(i, slot);
+                        else if (slot != std::numeric_limits<std::uint32_t>::max())
+                            kill(slot);
+                        if (alive)
+                            pending.insert(i);
+                        return;
+                    }
 
-                        auto clusterProperties = p.properties ? *p.properties : property_map{};
-                        if (num_points >= options_.minPoints)
-                        { // enough points to form a cluster
-                            point<double> weight = p.pos * double(num_points_origin);
-                            std::uint32_t id = static_cast<std::uint32_t>((i << 5) + (zoom + 1));
+                    const auto parent = old.parent_id;
+                    const auto center = parent >> 5;
+                    // members that moved out of reach of their center or lost it are placed
+                    // again, the cluster is computed again around its center
+                    const bool moved = alive && center != i &&
+                                       (previous.clusters[center].num_points == 0 ||
+                                        sqDist(e.pos, previous.clusters[center].pos) > r2);
+                    if (onlyMoved && !moved && center != i)
+                    {
+                        shifts[parent] += (e.pos - old.pos) * double(e.num_points);
+                        return;
+                    }
+                    dirty[parent] = dirty[parent] || (center == i && !alive);
+                    if (moved)
+                    {
+                        e.parent_id = 0;
+                        pending.insert(i);
+                    }
+                };
+                for (const auto &entry : changes.changed)
+                    changed(entry.first, entry.second, false);
+                for (const auto &entry : changes.moved)
+                    changed(entry.first, entry.second, true);
 
-                            // find all nearby points
-                            previous.tree.within(p.pos.x, p.pos.y, r, [&](const auto &neighbor_id)
-                                                 {
-                        assert(neighbor_id < cluster_size);
-                        auto &b = previous.clusters[neighbor_id];
+                // the members are the same and the center stayed, so the cluster only moves
+                for (const auto &entry : shifts)
+                {
+                    if (dirty.count(entry.first))
+                        continue;
+                    const auto slot = findCluster(entry.first, previous.clusters[entry.first >> 5].pos);
+                    assert(slot != std::numeric_limits<std::uint32_t>::max());
+                    change(slot, true);
+                    auto &c = zoom.clusters[slot];
+                    c.pos += entry.second / double(c.num_points);
+                    zoom.touch(slot);
+                }
 
-                        // filter out neighbors that are already processed
-                        if (b.visited) {
-                            return;
+                for (const auto &entry : dirty)
+                {
+                    const auto id = entry.first;
+                    const auto k = id >> 5;
+                    auto &center = previous.clusters[k];
+                    // members are around the center as it is now, and as it was
+                    const auto itr = previousBefore.find(k);
+                    const point<double> around[2] = {center.pos, itr != previousBefore.end() ? itr->second->pos : center.pos};
+
+                    auto slot = findCluster(id, around[0]);
+                    if (slot == std::numeric_limits<std::uint32_t>::max())
+                        slot = findCluster(id, around[1]);
+                    std::vector<std::uint32_t> members;
+                    for (std::size_t a = 0; a < 2; a++)
+                    {
+                        if (a == 1 && around[1] == around[0])
+                            break;
+                        previous.within(around[a].x, around[a].y, r, [&](const std::uint32_t n)
+                                        {
+                            if (n != k && previous.clusters[n].parent_id == id)
+                                members.push_back(n); });
+                    }
+                    std::sort(members.begin(), members.end());
+                    members.erase(std::unique(members.begin(), members.end()), members.end());
+
+                    bool dissolve = entry.second || center.num_points == 0 || center.parent_id != id;
+                    std::size_t num_points = center.num_points;
+                    if (!dissolve)
+                    {
+                        std::size_t kept = 0;
+                        for (const auto n : members)
+                        {
+                            auto &b = previous.clusters[n];
+                            if (sqDist(b.pos, center.pos) > r2)
+                            {
+                                b.parent_id = 0;
+                                pending.insert(n);
+                                continue;
+                            }
+                            num_points += b.num_points;
+                            members[kept++] = n;
                         }
+                        members.resize(kept);
+                        dissolve = num_points < options.minPoints;
+                    }
 
-                        b.visited = true;
-                        b.parent_id = id;
+                    if (dissolve)
+                    {
+                        if (slot != std::numeric_limits<std::uint32_t>::max())
+                            kill(slot);
+                        for (const auto n : members)
+                        {
+                            previous.clusters[n].parent_id = 0;
+                            pending.insert(n);
+                        }
+                        if (center.num_points > 0 && center.parent_id == id)
+                        {
+                            center.parent_id = 0;
+                            pending.insert(k);
+                        }
+                        continue;
+                    }
 
-                        // accumulate coordinates for calculating weighted center
-                        weight += b.pos * double(b.num_points);
+                    assert(slot != std::numeric_limits<std::uint32_t>::max());
+                    change(slot);
+                    setCluster(previous, zoom, slot, k, members);
+                }
 
-                        if (options_.reduce && b.properties) {
-                            // apply reduce function to update clusterProperites
-                            options_.reduce(clusterProperties, *b.properties);
+                while (!pending.empty())
+                {
+                    const auto i = *pending.begin();
+                    pending.erase(pending.begin());
+                    auto &e = previous.clusters[i];
+                    if (e.num_points == 0 || e.parent_id != 0)
+                        continue;
+
+                    // join the cluster with the lowest center index within reach
+                    auto center = std::numeric_limits<std::uint32_t>::max();
+                    std::vector<std::uint32_t> neighbors;
+                    std::size_t num_points = e.num_points;
+                    previous.within(e.pos.x, e.pos.y, r, [&](const std::uint32_t n)
+                                    {
+                        const auto &b = previous.clusters[n];
+                        if (n == i)
+                            return;
+                        if (b.parent_id == 0) {
+                            neighbors.push_back(n);
+                            num_points += b.num_points;
+                        } else if ((b.parent_id >> 5) == n && n < center) {
+                            center = n;
                         } });
-                            p.parent_id = id;
-                            clusters.emplace_back(weight / double(num_points), num_points, id,
-                                                  clusterProperties);
+
+                    if (center != std::numeric_limits<std::uint32_t>::max())
+                    {
+                        killCopy(i);
+                        const auto id = previous.clusters[center].parent_id;
+                        const auto slot = findCluster(id, previous.clusters[center].pos);
+                        assert(slot != std::numeric_limits<std::uint32_t>::max());
+                        change(slot);
+                        auto &c = zoom.clusters[slot];
+                        c.pos = (c.pos * double(c.num_points) + e.pos * double(e.num_points)) /
+                                double(c.num_points + e.num_points);
+                        c.num_points += e.num_points;
+                        zoom.touch(slot);
+                        e.parent_id = id;
+                        if (options.reduce && previous.propertiesOf(i))
+                        {
+                            auto properties = zoom.propertiesCopy(slot);
+                            options.reduce(properties, *previous.propertiesOf(i));
+                            zoom.setProperties(slot, options, std::move(properties));
                         }
-                        else
+                        if (stride > 0)
+                            accumulators.merge(zoom.row(slot, stride), previous.row(i, stride));
+                        continue;
+                    }
+
+                    if (num_points >= options.minPoints)
+                    {
+                        // a new cluster centered on e, taking in the single points around it
+                        const auto id = static_cast<std::uint32_t>((i << 5) + (z + 1));
+                        for (const auto n : neighbors)
                         {
-                            clusters.emplace_back(p.pos, 1, p.id, clusterProperties);
-                            if (num_points > 1)
-                            {
-                                previous.tree.within(p.pos.x, p.pos.y, r, [&](const auto &neighbor_id)
-                                                     {
-                            assert(neighbor_id < cluster_size);
-                            auto &b = previous.clusters[neighbor_id];
-                            // filter out neighbors that are already processed
-                            if (b.visited) {
-                                return;
-                            }
-                            b.visited = true;
-                            clusters.emplace_back(b.pos, 1, b.id,
-                                                  b.properties ? *b.properties : property_map{}); });
-                            }
+                            auto &b = previous.clusters[n];
+                            if (pending.erase(n))
+                                killCopy(n);
+                            else
+                                killPoint(b);
+                            b.parent_id = id;
                         }
+                        killCopy(i);
+                        e.parent_id = id;
+                        const auto slot = zoom.add(Cluster(e.pos, e.num_points, id), options, stride, true);
+                        appended.insert(slot);
+                        setCluster(previous, zoom, slot, i, neighbors);
+                    }
+                    else if (copies.count(i))
+                    {
+                        // still single, its copy moves along
+                        const auto slot = copies[i];
+                        copies.erase(i);
+                        change(slot, true);
+                        zoom.clusters[slot].pos = e.pos;
+                        zoom.touch(slot);
                     }
+                    else
+                    {
+                        const auto slot = zoom.add(Cluster(e.pos, e.num_points, e.id), options, stride, true);
+                        appended.insert(slot);
+                        zoom.setProperties(slot, options, previous.propertiesCopy(i));
+                        if (stride > 0)
+                            std::copy(previous.row(i, stride), previous.row(i, stride) + stride, zoom.row(slot, stride));
+                    }
+                }
 
-                    tree.fill(clusters);
+                assert(copies.empty());
+                zoom.freeSlots.insert(zoom.freeSlots.end(), released.begin(), released.end());
+                zoom.compact(options);
+
+                LevelChanges result;
+                for (const auto i : appended)
+                {
+                    if (zoom.clusters[i].num_points > 0)
+                        result.added.push_back(i);
                 }
-            };
+                std::sort(result.added.begin(), result.added.end());
+                for (auto &entry : before)
+                {
+                    (reshaped.count(entry.first) ? result.changed : result.moved).emplace_back(entry.first, entry.second);
+                }
+                const auto byIndex = [](const auto &a, const auto &b)
+                { return a.first < b.first; };
+                std::sort(result.changed.begin(), result.changed.end(), byIndex);
+                std::sort(result.moved.begin(), result.moved.end(), byIndex);
+                return result;
+            }
 
-            std::unordered_map<std::uint8_t, Zoom> zooms;
+            // computes cluster `slot` of zoom from the previous record k it is centered on and
+            // the other members, in the order of a full build
+            void setCluster(const Zoom &previous,
+                            Zoom &zoom,
+                            const std::uint32_t slot,
+                            const std::uint32_t k,
+                            const std::vector<std::uint32_t> &members)
+            {
+                const auto stride = accumulators.size();
+                const auto &center = previous.clusters[k];
+                auto &c = zoom.clusters[slot];
+                point<double> weight = center.pos * double(center.num_points);
+                std::uint32_t num_points = center.num_points;
+                auto properties = previous.propertiesCopy(k);
+                if (stride > 0)
+                    std::copy(previous.row(k, stride), previous.row(k, stride) + stride, zoom.row(slot, stride));
+                for (const auto n : members)
+                {
+                    const auto &b = previous.clusters[n];
+                    weight += b.pos * double(b.num_points);
+                    num_points += b.num_points;
+                    if (options.reduce && previous.propertiesOf(n))
+                        options.reduce(properties, *previous.propertiesOf(n));
+                    if (stride > 0)
+                        accumulators.merge(zoom.row(slot, stride), previous.row(n, stride));
+                }
+                c.pos = weight / double(num_points);
+                c.num_points = num_points;
+                zoom.touch(slot);
+                zoom.setProperties(slot, options, std::move(properties));
+            }
 
             std::uint8_t limitZoom(const std::uint8_t z) const
             {
@@ -2242,20 +5957,45 @@ namespace mapbox
 
             template <typename TVisitor>
             void eachChild(const std::uint32_t cluster_id, const TVisitor &visitor) const
+            {
+                if (!tryEachChild(cluster_id, visitor))
+                {
+                    throw std::runtime_error("No cluster with the specified id.");
+                }
+            }
+
+            // Visits the children of cluster_id like eachChild, returning false instead of throwing
+            // when there is no such cluster.
+            template <typename TVisitor>
+            bool tryEachChild(const std::uint32_t cluster_id, const TVisitor &visitor) const
             {
                 const auto origin_id = cluster_id >> 5;
                 const auto origin_zoom = cluster_id % 32;
 
+                // cluster ids count zoom levels from 1
+                if (origin_zoom == 0)
+                    return false;
+                // children are assigned to their cluster when its zoom level is updated
+                settle(static_cast<std::uint8_t>(origin_zoom - 1));
                 const auto zoom_iter = zooms.find(origin_zoom);
                 if (zoom_iter == zooms.end())
-                {
-                    throw std::runtime_error("No cluster with the specified id.");
-                }
+                    return false;
 
                 auto &zoom = zoom_iter->second;
                 if (origin_id >= zoom.clusters.size())
+                    return false;
+
+                // children recorded by the build, a slice of the level
+                if (origin_id + 1 < zoom.childOffsets.size())
                 {
-                    throw std::runtime_error("No cluster with the specified id.");
+                    const auto begin = zoom.childOffsets[origin_id];
+                    const auto end = zoom.childOffsets[origin_id + 1];
+                    for (auto k = begin; k < end; k++)
+                    {
+                        if (!kdbush::detail::visitContinue(visitor, zoom.clusters[zoom.children[k]]))
+                            break;
+                    }
+                    return begin != end;
                 }
 
                 const double r = options.radius / (double(options.extent) * std::pow(2, origin_zoom - 1));
@@ -2263,19 +6003,89 @@ namespace mapbox
 
                 bool hasChildren = false;
 
-                zoom.tree.within(origin.pos.x, origin.pos.y, r, [&](const auto &id)
-                                 {
+                zoom.within(origin.pos.x, origin.pos.y, r, [&](const auto &id)
+                            {
             assert(id < zoom.clusters.size());
             const auto &cluster_child = zoom.clusters[id];
-            if (cluster_child.parent_id == cluster_id) {
-                visitor(cluster_child);
-                hasChildren = true;
-            } });
+            if (cluster_child.parent_id != cluster_id) {
+                return true;
+            }
+            hasChildren = true;
+            return kdbush::detail::visitContinue(visitor, cluster_child); });
 
-                if (!hasChildren)
-                {
-                    throw std::runtime_error("No cluster with the specified id.");
-                }
+                return hasChildren;
+            }
+
+            // The expansion zoom of cluster_id read from its child list, 0 if it is not known
+            // without following the children.
+            std::uint8_t recordedExpansionZoom(const std::uint32_t cluster_id) const
+            {
+                const auto origin_zoom = cluster_id % 32;
+                if (origin_zoom > 0)
+                    settle(static_cast<std::uint8_t>(origin_zoom - 1));
+                const auto zoom_iter = zooms.find(origin_zoom);
+                if (zoom_iter == zooms.end())
+                    return 0;
+                const auto &zoom = zoom_iter->second;
+                const auto origin_id = cluster_id >> 5;
+                if (origin_id + 1 >= zoom.childOffsets.size())
+                    return 0;
+                const auto first = zoom.childOffsets[origin_id];
+                const auto last = zoom.childOffsets[origin_id + 1];
+                if (last - first > 1)
+                    return static_cast<std::uint8_t>(origin_zoom);
+                // the recorded zoom of the only child goes stale once updates change its subtree
+                if (last - first == 1 && expansionZoomsRecorded.load(std::memory_order_acquire))
+                    return zoom.clusters[zoom.children[first]].expansion_zoom;
+                return 0;
+            }
+
+            // The bounds of cluster_id recorded by the build, false if there are none.
+            bool recordedBounds(const std::uint32_t cluster_id, std::array<double, 4> &bounds) const
+            {
+                if (!boundsRecorded.load(std::memory_order_acquire))
+                    return false;
+                const auto origin_zoom = cluster_id % 32;
+                if (origin_zoom > 0)
+                    settle(static_cast<std::uint8_t>(origin_zoom - 1));
+                const auto zoom_iter = zooms.find(origin_zoom);
+                if (zoom_iter == zooms.end())
+                    return false;
+                const auto &zoom = zoom_iter->second;
+                const std::size_t origin_id = cluster_id >> 5;
+                if ((origin_id + 1) * 4 > zoom.clusterBounds.size())
+                    return false;
+                const float *b = &zoom.clusterBounds[origin_id * 4];
+                // records that are no center have empty bounds
+                if (!(b[0] <= b[2]))
+                    return false;
+                // y grows southwards
+                bounds = {xLng(b[0]), yLat(b[3]), xLng(b[2]), yLat(b[1])};
+                return true;
+            }
+
+            // The range of leafOrder holding the leaves of cluster_id, false if the leaves are not
+            // ordered or cluster_id is unknown.
+            bool leafRange(const std::uint32_t cluster_id, std::uint32_t &begin, std::uint32_t &end) const
+            {
+                if (!leavesOrdered.load(std::memory_order_acquire))
+                    return false;
+                const auto zoom_iter = zooms.find(cluster_id % 32);
+                if (zoom_iter == zooms.end())
+                    return false;
+                const auto &zoom = zoom_iter->second;
+                const auto origin_id = cluster_id >> 5;
+                if (origin_id + 1 >= zoom.childOffsets.size() || zoom.leafBegin.size() != zoom.clusters.size())
+                    return false;
+                const auto first = zoom.childOffsets[origin_id];
+                const auto last = zoom.childOffsets[origin_id + 1];
+                if (first == last)
+                    return false;
+                // the children of a cluster are consecutive in its range
+                const auto lastChild = zoom.children[last - 1];
+                begin = zoom.leafBegin[zoom.children[first]];
+                end = zoom.leafBegin[lastChild] + zoom.clusters[lastChild].num_points;
+                return true;
             }
 
             template <typename TVisitor>
@@ -2285,11 +6095,23 @@ namespace mapbox
                           std::uint32_t &skipped,
                           const TVisitor &visitor) const
             {
+                std::uint32_t begin = 0;
+                std::uint32_t end = 0;
+                if (leafRange(cluster_id, begin, end))
+                {
+                    // a slice of leafOrder, skipped without visiting the leaves before it
+                    const auto &base = zooms.find(options.maxZoom + 1)->second;
+                    const auto skip = std::min(offset - skipped, end - begin);
+                    skipped += skip;
+                    for (auto k = begin + skip; k < end && limit > 0; k++, limit--)
+                        visitor(base.clusters[leafOrder[k]]);
+                    return;
+                }
 
                 eachChild(cluster_id, [&, this](const auto &cluster_leaf)
                           {
             if (limit == 0)
-                return;
+                return false;
             if (cluster_leaf.num_points > 1) {
                 if (skipped + cluster_leaf.num_points <= offset) {
                     // skip the whole cluster
@@ -2306,12 +6128,51 @@ namespace mapbox
                 // visit a single point
                 visitor(cluster_leaf);
                 limit--;
-            } });
+            }
+            // stop looking at siblings once the page is full
+            return limit > 0; });
             }
 
             GeoJSONFeature clusterToGeoJSON(const Cluster &c) const
             {
-                return c.num_points == 1 ? features[c.id] : c.toGeoJSON();
+                if (c.num_points == 1 && !lngLat.empty())
+                    return GeoJSONFeature{GeoJSONPoint(lngLat[2 * c.id], lngLat[2 * c.id + 1]), property_map{}, pointId(c.id)};
+                if (c.num_points == 1)
+                    return features[c.id];
+                auto feature = c.toGeoJSON();
+                feature.properties.emplace("expansion_zoom", static_cast<std::uint64_t>(expansionZoom(c)));
+                appendClusterProperties(c, feature.properties);
+                return feature;
+            }
+
+            identifier pointId(const std::uint32_t i) const
+            {
+                return identifier(static_cast<std::uint64_t>(pointIds.empty() ? i : pointIds[i]));
+            }
+
+            property_map clusterProperties(const Cluster &c) const
+            {
+                auto properties = c.getProperties();
+                appendClusterProperties(c, properties);
+                return properties;
+            }
+
+            // Adds the map / reduce properties and aggregates of c, which are stored next to it.
+            // c must be stored in its zoom level, which is encoded in the cluster id.
+            void appendClusterProperties(const Cluster &c, property_map &properties) const
+            {
+                if (!options.reduce && accumulators.size() == 0)
+                    return;
+                const auto &zoom = zooms.at(static_cast<std::uint8_t>((c.id & 0b11111) - 1));
+                const auto index = static_cast<std::size_t>(&c - zoom.clusters.data());
+                assert(index < zoom.clusters.size());
+                if (const auto *reduced = zoom.propertiesOf(index))
+                {
+                    for (const auto &property : *reduced)
+                        properties.emplace(property);
+                }
+                if (accumulators.size() > 0)
+                    accumulators.output(properties, &zoom.aggregates[index * accumulators.size()]);
             }
 
             static double lngX(double lng)
@@ -2319,6 +6180,16 @@ namespace mapbox
                 return lng / 360 + 0.5;
             }
 
+            static double xLng(double x)
+            {
+                return (x - 0.5) * 360.0;
+            }
+
+            static double yLat(double y)
+            {
+                return 360.0 * std::atan(std::exp((180.0 - y * 360.0) * M_PI / 180)) / M_PI - 90.0;
+            }
+
             static double latY(double lat)
             {
                 const double sine = std::sin(lat * M_PI / 180);
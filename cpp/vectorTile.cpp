@@ -0,0 +1,163 @@
+#include "vectorTile.hpp"
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace margelo::nitro::clusterer {
+
+namespace {
+
+// protobuf wire types
+constexpr std::uint32_t varintType = 0;
+constexpr std::uint32_t fixed64Type = 1;
+constexpr std::uint32_t bytesType = 2;
+
+// vector tile commands and geometry types
+constexpr std::uint32_t moveTo = 1;
+constexpr std::uint32_t pointType = 1;
+
+void writeVarint(std::string &out, std::uint64_t value) {
+  while(value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+void writeTag(std::string &out, std::uint32_t field, std::uint32_t type) {
+  writeVarint(out, (field << 3) | type);
+}
+
+void writeBytes(std::string &out, std::uint32_t field,
+                const std::string &bytes) {
+  writeTag(out, field, bytesType);
+  writeVarint(out, bytes.size());
+  out.append(bytes);
+}
+
+std::uint32_t zigzag(std::int32_t value) {
+  return (static_cast<std::uint32_t>(value) << 1) ^
+         static_cast<std::uint32_t>(value >> 31);
+}
+
+// Value message of a property, empty for types a vector tile can't hold
+std::string encodeValue(const mapbox::feature::value &value) {
+  std::string out;
+  if(value.is<bool>()) {
+    writeTag(out, 7, varintType);
+    writeVarint(out, value.get<bool>() ? 1 : 0);
+  } else if(value.is<std::uint64_t>()) {
+    writeTag(out, 5, varintType);
+    writeVarint(out, value.get<std::uint64_t>());
+  } else if(value.is<std::int64_t>()) {
+    // sint_value
+    auto i = value.get<std::int64_t>();
+    writeTag(out, 6, varintType);
+    writeVarint(out, (static_cast<std::uint64_t>(i) << 1) ^
+                         static_cast<std::uint64_t>(i >> 63));
+  } else if(value.is<double>()) {
+    auto d = value.get<double>();
+    char bytes[sizeof(double)];
+    std::memcpy(bytes, &d, sizeof(double));
+    writeTag(out, 3, fixed64Type);
+    out.append(bytes, sizeof(double));
+  } else if(value.is<std::string>()) {
+    writeBytes(out, 1, value.get<std::string>());
+  }
+  return out;
+}
+
+// keys and values of a layer, each stored once and referenced by index
+class TagTable {
+ public:
+  std::uint32_t key(const std::string &name) {
+    auto itr = keyIndex.find(name);
+    if(itr != keyIndex.end()) return itr->second;
+    keys.push_back(name);
+    return keyIndex.emplace(name, keys.size() - 1).first->second;
+  }
+
+  // values are deduplicated by their encoded message
+  std::uint32_t value(std::string &&encoded) {
+    auto itr = valueIndex.find(encoded);
+    if(itr != valueIndex.end()) return itr->second;
+    values.push_back(encoded);
+    return valueIndex.emplace(std::move(encoded), values.size() - 1)
+        .first->second;
+  }
+
+  std::vector<std::string> keys;
+  std::vector<std::string> values;
+
+ private:
+  std::unordered_map<std::string, std::uint32_t> keyIndex;
+  std::unordered_map<std::string, std::uint32_t> valueIndex;
+};
+
+std::string encodeFeature(const mapbox::feature::feature<std::int16_t> &f,
+                          TagTable &table) {
+  std::string out;
+
+  // id
+  if(f.id.is<std::uint64_t>()) {
+    writeTag(out, 1, varintType);
+    writeVarint(out, f.id.get<std::uint64_t>());
+  } else if(f.id.is<std::int64_t>() && f.id.get<std::int64_t>() >= 0) {
+    writeTag(out, 1, varintType);
+    writeVarint(out, f.id.get<std::int64_t>());
+  }
+
+  // tags, packed key / value index pairs
+  std::string tags;
+  for(auto &property : f.properties) {
+    auto value = encodeValue(property.second);
+    if(value.empty()) continue;
+    writeVarint(tags, table.key(property.first));
+    writeVarint(tags, table.value(std::move(value)));
+  }
+  if(!tags.empty()) writeBytes(out, 2, tags);
+
+  // type
+  writeTag(out, 3, varintType);
+  writeVarint(out, pointType);
+
+  // geometry, a single MoveTo relative to the tile origin
+  auto point = f.geometry.get<mapbox::geometry::point<std::int16_t>>();
+  std::string geometry;
+  writeVarint(geometry, (1 << 3) | moveTo);
+  writeVarint(geometry, zigzag(point.x));
+  writeVarint(geometry, zigzag(point.y));
+  writeBytes(out, 4, geometry);
+
+  return out;
+}
+
+}  // namespace
+
+std::string encodeVectorTile(
+    const mapbox::feature::feature_collection<std::int16_t> &features,
+    const std::string &layerName, std::uint32_t extent) {
+  std::string layer;
+  TagTable table;
+
+  // version
+  writeTag(layer, 15, varintType);
+  writeVarint(layer, 2);
+  // name
+  writeBytes(layer, 1, layerName);
+  // features
+  for(auto &f : features) writeBytes(layer, 2, encodeFeature(f, table));
+  // keys and values
+  for(auto &key : table.keys) writeBytes(layer, 3, key);
+  for(auto &value : table.values) writeBytes(layer, 4, value);
+  // extent
+  writeTag(layer, 5, varintType);
+  writeVarint(layer, extent);
+
+  std::string tile;
+  if(!features.empty()) writeBytes(tile, 3, layer);
+  return tile;
+}
+
+}  // namespace margelo::nitro::clusterer
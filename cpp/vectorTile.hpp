@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "supercluster.hpp"
+
+namespace margelo::nitro::clusterer {
+
+// Encodes the features of Supercluster::getTile as a Mapbox Vector Tile
+// (https://github.com/mapbox/vector-tile-spec) with a single point layer.
+// Keys and values are deduplicated across the layer, property values that
+// have no vector tile type (null, arrays, objects) are left out.
+std::string encodeVectorTile(
+    const mapbox::feature::feature_collection<std::int16_t> &features,
+    const std::string &layerName, std::uint32_t extent);
+
+}  // namespace margelo::nitro::clusterer
@@ -30,6 +30,7 @@ const GetClusters: FunctionComponent<Props> = ({ data }) => {
   const [numberOfRuns, setNumberOfRuns] = useState('100');
   const [jsTimeAverage, setJsTimeAverage] = useState('0');
   const [cppTimeAverage, setCppTimeAverage] = useState('0');
+  const [serializationTime, setSerializationTime] = useState(['0', '0']);
 
   const zoomInt = parseInt(zoom, 10);
   const bbox = [westLng, southLat, eastLng, northLat].map(parseFloat) as BBox;
@@ -140,6 +141,36 @@ const GetClusters: FunctionComponent<Props> = ({ data }) => {
     );
   };
 
+  // getClusters cost per 10k returned features, with GeoJSON objects and
+  // with reused typed arrays, over every zoom level of the whole world
+  const _handleSerializationBenchmark = () => {
+    const supercluster = new Supercluster(superclusterOptions);
+    supercluster.load(data);
+
+    const world: BBox = [-180, -90, 180, 90];
+    let features = 0;
+    let objectsTime = 0;
+    let columnarTime = 0;
+    let columns:
+      | ReturnType<typeof supercluster.getClustersColumnar>
+      | undefined;
+
+    for (let z = 0; z <= superclusterOptions.maxZoom + 1; z++) {
+      const start = PerformanceNow();
+      features += supercluster.getClusters(world, z).length;
+      const mid = PerformanceNow();
+      columns = supercluster.getClustersColumnar(world, z, columns);
+      const end = PerformanceNow();
+
+      objectsTime += mid - start;
+      columnarTime += end - mid;
+    }
+
+    const per10k = (time: number) =>
+      timeDelta(0, (time / Math.max(features, 1)) * 10000);
+    setSerializationTime([per10k(objectsTime), per10k(columnarTime)]);
+  };
+
   return (
     <SafeAreaView style={styles.container}>
       <View style={styles.rowContainer}>
@@ -236,6 +267,19 @@ const GetClusters: FunctionComponent<Props> = ({ data }) => {
       <Text>JS average time: {jsTimeAverage} ms</Text>
       <Text>C++ average time: {cppTimeAverage} ms</Text>
 
+      <Text style={styles.h2}>Serialization per 10k features</Text>
+      <View style={styles.buttonContainer}>
+        <TouchableOpacity
+          style={styles.button}
+          onPress={_handleSerializationBenchmark}
+        >
+          <Text>Run serialization benchmark</Text>
+        </TouchableOpacity>
+      </View>
+
+      <Text>GeoJSON objects: {serializationTime[0]} ms</Text>
+      <Text>Columnar: {serializationTime[1]} ms</Text>
+
       <Modal
         visible={showModal}
         transparent={true}
@@ -1,4 +1,4 @@
-import { type FunctionComponent } from 'react';
+import { type FunctionComponent, useEffect, useState } from 'react';
 import { StyleSheet, View, Text } from 'react-native';
 
 import Supercluster from 'react-native-clusterer';
@@ -8,6 +8,30 @@ import { deepEqualWithoutIds, superclusterOptions } from './utils';
 import { getRandomData } from './places';
 
 export const Tests: FunctionComponent<{}> = () => {
+  const [destroyedAfterFailedLoad, setDestroyedAfterFailedLoad] = useState<
+    boolean | undefined
+  >();
+
+  const destroysClustererWhoseLoadFailed = async () => {
+    for (let i = 0; i < 20; i++) {
+      // a longitude without its latitude rejects before an index is built
+      const rejected = await new Supercluster()
+        .loadAsync(new Float64Array(3))
+        .then(
+          () => false,
+          () => true
+        );
+      if (!rejected) return false;
+    }
+    // the clusterers are unreachable now, destroying them must not crash
+    (globalThis as any).gc?.();
+    return true;
+  };
+
+  useEffect(() => {
+    destroysClustererWhoseLoadFailed().then(setDestroyedAfterFailedLoad);
+  }, []);
+
   const generatesClustersProperly = () => {
     const index = new Supercluster().load(places.features);
     const tile = index.getTile(0, 0, 0);
@@ -101,6 +125,71 @@ export const Tests: FunctionComponent<{}> = () => {
     return index.getClusterExpansionZoom(2341) === 5;
   };
 
+  const clustersCarryExpansionZoom = () => {
+    const index = new Supercluster().load(places.features);
+    const clusters = index
+      .getClusters([-180, -85, 180, 85], 1)
+      .filter((f: any) => f.properties.cluster);
+    return (
+      clusters.length > 0 &&
+      clusters.every(
+        (f: any) =>
+          f.properties.expansion_zoom ===
+          index.getClusterExpansionZoom(f.properties.cluster_id)
+      )
+    );
+  };
+
+  const clusterBoundsContainLeaves = () => {
+    const index = new Supercluster().load(places.features);
+    const columns = index.getClustersColumnar([-180, -85, 180, 85], 1);
+    const bounds = index.getClustersBounds(columns);
+    for (let i = 0; i < columns.length; i++) {
+      if (!columns.isCluster[i]) continue;
+      const [w, s, e, n] = index.getClusterBounds(columns.id[i]!);
+      if (
+        w !== bounds[4 * i] ||
+        s !== bounds[4 * i + 1] ||
+        e !== bounds[4 * i + 2] ||
+        n !== bounds[4 * i + 3]
+      )
+        return false;
+      const leaves = index.getLeaves(columns.id[i]!, Infinity);
+      const lngs = leaves.map((p) => p.geometry.coordinates[0]!);
+      const lats = leaves.map((p) => p.geometry.coordinates[1]!);
+      // recorded bounds are rounded outwards to single precision
+      if (
+        Math.abs(w - Math.min(...lngs)) > 1e-4 ||
+        Math.abs(s - Math.min(...lats)) > 1e-4 ||
+        Math.abs(e - Math.max(...lngs)) > 1e-4 ||
+        Math.abs(n - Math.max(...lats)) > 1e-4 ||
+        lngs.some((x) => x < w || x > e) ||
+        lats.some((y) => y < s || y > n)
+      )
+        return false;
+    }
+    return columns.length > 0;
+  };
+
+  const checksClusterIdsWithoutThrowing = () => {
+    const index = new Supercluster().load(places.features);
+    const ids = index
+      .getClusters([-180, -85, 180, 85], 1)
+      .filter((f: any) => f.properties.cluster)
+      .map((f: any) => f.properties.cluster_id);
+    return (
+      ids.length > 0 &&
+      ids.every((id) => index.hasCluster(id)) &&
+      // ids of no zoom level, past the records of a level, and no 32 bit integers
+      !index.hasCluster(0) &&
+      !index.hasCluster(31) &&
+      !index.hasCluster((places.features.length << 5) + 2) &&
+      !index.hasCluster(-1) &&
+      !index.hasCluster(2 ** 40) &&
+      !index.hasCluster(ids[0] + 0.5)
+    );
+  };
+
   const returnsClustersWhenQueryCrossesInternationalDateline = () => {
     const index = new Supercluster().load([
       {
@@ -239,6 +328,149 @@ export const Tests: FunctionComponent<{}> = () => {
     return deepEqualWithoutIds(dataCPP, dataJS);
   };
 
+  const aggregatesClusterPropertiesWithReduce = () => {
+    const index = new Supercluster({
+      radius: 100,
+      reduce: { sum: ['sum', 'scalerank'], maxRank: ['max', 'scalerank'] },
+    }).load(places.features);
+    const indexJS = new SuperclusterJS({
+      radius: 100,
+      map: (props) => ({ sum: props.scalerank, maxRank: props.scalerank }),
+      reduce: (a, b) => {
+        a.sum += b.sum;
+        a.maxRank = Math.max(a.maxRank, b.maxRank);
+      },
+    }).load(places.features);
+    const aggregates = (features: any[]) =>
+      features
+        .filter((f) => f.properties.cluster)
+        .map((f) => [f.properties.sum, f.properties.maxRank]);
+    return deepEqualWithoutIds(
+      aggregates(index.getClusters([-180, -85, 180, 85], 1)),
+      aggregates(indexJS.getClusters([-180, -85, 180, 85], 1))
+    );
+  };
+
+  const loadCoordinatesMatchesLoad = () => {
+    const lngLat = new Float64Array(
+      places.features.flatMap((f) => f.geometry.coordinates)
+    );
+    const index = new Supercluster().load(places.features);
+    const indexCoordinates = new Supercluster().loadCoordinates(lngLat);
+    const clusters = (features: any[]) =>
+      features.map((f) => [
+        f.geometry.coordinates,
+        f.properties.point_count ?? 1,
+      ]);
+    return deepEqualWithoutIds(
+      clusters(index.getClusters([-180, -85, 180, 85], 2)),
+      clusters(indexCoordinates.getClusters([-180, -85, 180, 85], 2))
+    );
+  };
+
+  const columnarClustersMatchGetClusters = () => {
+    const index = new Supercluster().load(places.features);
+    const clusters = index.getClusters([-180, -85, 180, 85], 1);
+    const columns = index.getClustersColumnar([-180, -85, 180, 85], 1);
+    const reused = index.getClustersColumnar(
+      [-180, -85, 180, 85],
+      1,
+      columns
+    );
+    return (
+      reused.lng === columns.lng &&
+      columns.length === clusters.length &&
+      clusters.every(
+        (f: any, i) =>
+          f.geometry.coordinates[0] === columns.lng[i] &&
+          f.geometry.coordinates[1] === columns.lat[i] &&
+          (f.properties.point_count ?? 1) === columns.pointCount[i] &&
+          (f.properties.expansion_zoom ?? 0) === columns.expansionZoom[i]
+      )
+    );
+  };
+
+  const diffsClustersBetweenQueries = () => {
+    const index = new Supercluster().load(places.features);
+    const first = index.diffClusters([-180, -85, 0, 85], 2);
+    const second = index.diffClusters([-90, -85, 90, 85], 2);
+    const expected = index.getClusters([-90, -85, 90, 85], 2).length;
+    return (
+      first.removed.length === 0 &&
+      second.removed.every((f) => first.added.includes(f)) &&
+      second.unchangedCount + second.added.length === expected &&
+      first.added.length - second.removed.length === second.unchangedCount
+    );
+  };
+
+  const encodesVectorTile = () => {
+    const index = new Supercluster().load(places.features);
+    const tile = new Uint8Array(index.getVectorTile(0, 0, 0));
+    // layers field of the tile, its varint length, then the layer version 2
+    let i = 1;
+    while (tile[i]! & 0x80) i++;
+    return tile[0] === 0x1a && tile[i + 1] === 0x78 && tile[i + 2] === 2;
+  };
+
+  const insertRemoveKeepsPointCount = () => {
+    const index = new Supercluster().load(places.features.slice(0, 100));
+    index.insert(places.features.slice(100));
+    const removed = index.remove([0, 1, 2, 150, -1, 2.5, 2 ** 40]);
+    const total = (z: number) =>
+      index
+        .getClusters([-180, -85, 180, 85], z)
+        .reduce((sum, f: any) => sum + (f.properties.point_count ?? 1), 0);
+    const expected = places.features.length - removed;
+    return removed === 4 && [0, 2, 4, 16].every((z) => total(z) === expected);
+  };
+
+  const updatePositionsMovesPoints = () => {
+    const index = new Supercluster().load(places.features);
+    const ids = Uint32Array.from({ length: 10 }, (_, i) => i);
+    const moved = index.updatePositions(ids, new Float64Array(20));
+    const clusters = index.getClusters([-1, -1, 1, 1], 16) as any[];
+    return (
+      moved === 10 &&
+      clusters.length === 1 &&
+      clusters[0].properties.point_count === 10
+    );
+  };
+
+  const lazyZoomsGiveSameClusters = () => {
+    const eager = new Supercluster().load(places.features);
+    const lazy = new Supercluster({ lazyZooms: true }).load(places.features);
+    return [5, 0, 12, 3].every(
+      (z) =>
+        JSON.stringify(lazy.getClusters([-180, -85, 180, 85], z)) ===
+        JSON.stringify(eager.getClusters([-180, -85, 180, 85], z))
+    );
+  };
+
+  const deserializedIndexGivesSameClusters = () => {
+    const index = new Supercluster().load(places.features);
+    const restored = new Supercluster().deserialize(
+      index.serialize(),
+      places.features
+    );
+    return [0, 2, 4, 16].every(
+      (z) =>
+        JSON.stringify(restored.getClusters([-180, -85, 180, 85], z)) ===
+        JSON.stringify(index.getClusters([-180, -85, 180, 85], z))
+    );
+  };
+
+  const rejectsCorruptedSnapshot = () => {
+    const index = new Supercluster().load(places.features);
+    const snapshot = new Uint8Array(index.serialize());
+    snapshot[snapshot.length >> 1]! ^= 0x10;
+    try {
+      new Supercluster().deserialize(snapshot.buffer, places.features);
+      return false;
+    } catch {
+      return true;
+    }
+  };
+
   return (
     <View style={styles.container}>
       <Text>
@@ -269,6 +501,26 @@ export const Tests: FunctionComponent<{}> = () => {
         returns cluster expansion zoom for maxZoom{' '}
         {returnsClusterExpansionZoomForMaxZoom() ? '✅' : '❌'}
       </Text>
+      <Text>
+        clusters carry their expansion zoom{' '}
+        {clustersCarryExpansionZoom() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        cluster bounds contain their leaves{' '}
+        {clusterBoundsContainLeaves() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        checks cluster ids without throwing{' '}
+        {checksClusterIdsWithoutThrowing() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        destroys a clusterer whose load failed{' '}
+        {destroyedAfterFailedLoad === undefined
+          ? '⏳'
+          : destroyedAfterFailedLoad
+            ? '✅'
+            : '❌'}
+      </Text>
       <Text>
         returns clusters when query crosses international dateline{' '}
         {returnsClustersWhenQueryCrossesInternationalDateline() ? '✅' : '❌'}
@@ -292,6 +544,44 @@ export const Tests: FunctionComponent<{}> = () => {
       <Text>
         does not throw on zero items {doesNotThrowOnZeroItems() ? '✅' : '❌'}
       </Text>
+      <Text>
+        aggregates cluster properties with reduce{' '}
+        {aggregatesClusterPropertiesWithReduce() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        loadCoordinates matches load{' '}
+        {loadCoordinatesMatchesLoad() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        columnar clusters match getClusters{' '}
+        {columnarClustersMatchGetClusters() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        diffs clusters between queries{' '}
+        {diffsClustersBetweenQueries() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        encodes vector tile {encodesVectorTile() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        insert and remove keep point count{' '}
+        {insertRemoveKeepsPointCount() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        update positions moves points{' '}
+        {updatePositionsMovesPoints() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        lazy zooms give the same clusters{' '}
+        {lazyZoomsGiveSameClusters() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        deserialized index gives the same clusters{' '}
+        {deserializedIndexGivesSameClusters() ? '✅' : '❌'}
+      </Text>
+      <Text>
+        rejects corrupted snapshot {rejectsCorruptedSnapshot() ? '✅' : '❌'}
+      </Text>
 
       <Text>
         results are the same as JS {resultsAreTheSameAsJS() ? '✅' : '❌'}
@@ -37,9 +37,15 @@ export const deepEqualWithoutIds = (x: any, y: any) => {
   // test there constructor.
 
   for (var p in x) {
-    if (p === 'id' || p === 'cluster_id' || p === 'getExpansionRegion')
+    if (
+      p === 'id' ||
+      p === 'cluster_id' ||
+      p === 'getExpansionRegion' ||
+      p === 'expansion_zoom'
+    )
       continue;
-    // skip id and cluster_id and getExpansionRegion
+    // skip id and cluster_id, and getExpansionRegion and expansion_zoom that
+    // supercluster does not have
 
     if (!x.hasOwnProperty(p)) continue;
     // other properties were tested using x.constructor === y.constructor
@@ -74,7 +80,12 @@ export const deepEqualWithoutIds = (x: any, y: any) => {
   }
 
   for (p in y) {
-    if (p === 'id' || p === 'cluster_id' || p === 'getExpansionRegion')
+    if (
+      p === 'id' ||
+      p === 'cluster_id' ||
+      p === 'getExpansionRegion' ||
+      p === 'expansion_zoom'
+    )
       continue;
     // skip id and cluster_id
 
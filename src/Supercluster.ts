@@ -1,11 +1,6 @@
 // import { NativeModules, Platform } from 'react-native';
 import GeoViewport from '@mapbox/geo-viewport';
-import {
-  getMarkersCoordinates,
-  getMarkersRegion,
-  isClusterFeature,
-  regionToBBox,
-} from './utils';
+import { getMarkersRegion, isClusterFeature, regionToBBox } from './utils';
 
 import type * as GeoJSON from 'geojson';
 import type { MapDimensions, Region } from './types';
@@ -22,6 +17,11 @@ const defaultOptions = {
   extent: 512, // tile extent (radius is calculated relative to it)
   log: false, // whether to log timing info
   generateId: false, // whether to generate numeric ids for input features (in vector tiles)
+  threads: 1, // threads used to build the index (0 = one per CPU core)
+  indexPrecision: 'double' as const, // coordinate storage of the native KD-trees
+  tileCacheSize: 0, // bytes of getTile results to cache (0 = no cache)
+  lazyZooms: false, // build zoom levels on first query instead of on load
+  reduce: {}, // natively aggregated cluster properties
 };
 
 export default class SuperclusterClass<
@@ -29,7 +29,14 @@ export default class SuperclusterClass<
   C extends GeoJSON.GeoJsonProperties = Supercluster.AnyProps,
 > {
   private clusterer: any | null = null;
+  // whether the native index has been built
+  private loaded = false;
   private options: Required<Supercluster.Options<P, C>>;
+  // features currently visible to diffClusters, by native cluster key
+  private visible = new Map<
+    number,
+    Supercluster.ClusterFeature<C> | Supercluster.PointFeature<P>
+  >();
 
   constructor(options?: Supercluster.Options<P, C>) {
     this.options = { ...defaultOptions, ...options };
@@ -37,7 +44,8 @@ export default class SuperclusterClass<
 
   /**
    * Loads an array of GeoJSON Feature objects. Each feature's geometry
-   * must be a GeoJSON Point. Once loaded, index is immutable.
+   * must be a GeoJSON Point. Can only be called once; the loaded index is
+   * then updated in place with `insert`, `remove` and `updatePositions`.
    *
    * @param points Array of GeoJSON Features, the geometries being GeoJSON Points.
    */
@@ -49,9 +57,146 @@ export default class SuperclusterClass<
     }
     this.clusterer = NitroModules.createHybridObject<Clusterer>('Clusterer');
     this.clusterer.load(points, this.options);
+    this.loaded = true;
     return this;
   }
 
+  /**
+   * Loads points given as interleaved longitude / latitude pairs
+   * (`[lng0, lat0, lng1, lat1, ...]`). The typed arrays are copied to the
+   * native index directly, without creating a GeoJSON Feature per point.
+   * Points are returned with `ids[i]` (or `i` without ids) as `id` and empty
+   * properties. Can only be called once; the loaded index is then updated in
+   * place with `insert`, `remove` and `updatePositions`.
+   *
+   * @param lngLat Longitude / latitude pairs.
+   * @param ids Optional id of every point.
+   */
+  loadCoordinates(lngLat: Float64Array, ids?: Uint32Array): this {
+    if (this.clusterer) {
+      throw new Error(
+        'React-Native-Clusterer: The .load() method can only be called once.'
+      );
+    }
+    this.clusterer = NitroModules.createHybridObject<Clusterer>('Clusterer');
+    this.clusterer.loadCoordinates(lngLat, this.options, ids);
+    this.loaded = true;
+    return this;
+  }
+
+  /**
+   * Builds the index on a background thread. Only the coordinates (and the
+   * properties aggregated by `reduce`) are read on the JS thread; the
+   * clustering itself doesn't block it. Unlike `load`, it can be called
+   * again to replace the data: the previous index keeps answering queries
+   * until the new one is ready, and a newer call rejects any pending one.
+   *
+   * @param points Array of GeoJSON Point Features, or longitude / latitude
+   * pairs as in `loadCoordinates`.
+   * @param ids Optional id of every point, with `Float64Array` points only.
+   */
+  async loadAsync(
+    points: Array<Supercluster.PointFeature<P>> | Float64Array,
+    ids?: Uint32Array
+  ): Promise<this> {
+    if (!this.clusterer) {
+      this.clusterer = NitroModules.createHybridObject<Clusterer>('Clusterer');
+    }
+    await this.clusterer.loadAsync(points, this.options, ids);
+    this.loaded = true;
+    this.visible.clear();
+    return this;
+  }
+
+  /**
+   * Restores an index saved with `serialize` without clustering the points
+   * again, e.g. for a dataset that ships with the app. The options must be
+   * the ones the snapshot was built with.
+   *
+   * @param snapshot Snapshot returned by `serialize`, or the path of a file
+   * holding one, which is mapped natively and queried in place.
+   * @param features The GeoJSON Features of an index created with `load`,
+   * in the order they were loaded and inserted.
+   */
+  deserialize(
+    snapshot: ArrayBuffer | string,
+    features?: Array<Supercluster.PointFeature<P>>
+  ): this {
+    if (this.clusterer) {
+      throw new Error(
+        'React-Native-Clusterer: The .load() method can only be called once.'
+      );
+    }
+    this.clusterer = NitroModules.createHybridObject<Clusterer>('Clusterer');
+    this.clusterer.deserialize(snapshot, this.options, features);
+    this.loaded = true;
+    return this;
+  }
+
+  /**
+   * Saves the loaded index as a binary snapshot that `deserialize` restores
+   * without clustering again: the points and every zoom level with its
+   * KD-tree. Write it to a file to skip building the index on later
+   * launches.
+   */
+  serialize(): ArrayBuffer {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.serialize();
+  }
+
+  /**
+   * Adds points to the loaded index without rebuilding it: only the
+   * neighborhoods of the new points are clustered again on every zoom level.
+   * Pass GeoJSON Features to an index loaded with `load`, or longitude /
+   * latitude pairs (and optional ids) to one loaded with `loadCoordinates`.
+   * Inserted GeoJSON points get the next point indices.
+   *
+   * @param points Array of GeoJSON Point Features, or longitude / latitude
+   * pairs.
+   * @param ids Optional id of every point, with `Float64Array` points only.
+   */
+  insert(
+    points: Array<Supercluster.PointFeature<P>> | Float64Array,
+    ids?: Uint32Array
+  ): this {
+    this.throwIfNotInitialized();
+
+    this.clusterer.insert(points, ids);
+    return this;
+  }
+
+  /**
+   * Removes points from the loaded index without rebuilding it. Points are
+   * identified by their id with `loadCoordinates` (`ids[i]`, or `i` without
+   * ids), and by their index in the loaded and inserted features otherwise.
+   * Unknown ids are ignored.
+   *
+   * @param ids Ids of the points to remove.
+   * @returns Number of points removed.
+   */
+  remove(ids: Array<number> | Uint32Array): number {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.remove(ids);
+  }
+
+  /**
+   * Moves points of the loaded index, e.g. tracked vehicles, without
+   * rebuilding it. Only the moved points are projected again, and only the
+   * clusters they left or joined are computed again. Points are identified
+   * as in `remove`, unknown ids are ignored.
+   *
+   * @param ids Ids of the points to move.
+   * @param lngLat New longitude / latitude pair of every point.
+   * @returns Number of points moved.
+   */
+  updatePositions(ids: Uint32Array, lngLat: Float64Array): number {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.updatePositions(ids, lngLat);
+  }
+
   /**
    * Returns an array of clusters and points as `GeoJSON.Feature` objects
    * for the given bounding box (`bbox`) and zoom level (`zoom`).
@@ -103,6 +248,71 @@ export default class SuperclusterClass<
       .map(this.addExpansionRegionToCluster);
   }
 
+  /**
+   * Returns how the result of `getClusters` changed since the previous call
+   * of `diffClusters`: the features that were added and removed, and the
+   * number of unchanged ones. Removed features are the objects returned
+   * earlier in `added`, so rendering work scales with the changes instead
+   * of the viewport size. Clusters changed by `insert`, `remove` or
+   * `updatePositions` are reported as removed and added again.
+   *
+   * @param bbox Bounding box (`[westLng, southLat, eastLng, northLat]`).
+   * @param zoom Zoom level.
+   */
+  diffClusters(
+    bbox: GeoJSON.BBox,
+    zoom: number
+  ): Supercluster.ClusterDiff<P, C> {
+    this.throwIfNotInitialized();
+
+    const diff = this.clusterer.diffClusters(bbox, zoom);
+    const removed = diff.removed.map((key: number) => {
+      const feature = this.visible.get(key)!;
+      this.visible.delete(key);
+      return feature;
+    });
+    const added = diff.added.map((feature: any, i: number) => {
+      this.addExpansionRegionToCluster(feature);
+      this.visible.set(diff.addedKeys[i], feature);
+      return feature;
+    });
+    return { added, removed, unchangedCount: diff.unchangedCount };
+  }
+
+  /**
+   * Same as `getClusters`, but returns the clusters and points as parallel
+   * typed arrays instead of GeoJSON Features. Pass the previous result as
+   * `out` to reuse its arrays, so repeated queries allocate nothing in JS.
+   *
+   * @param bbox Bounding box (`[westLng, southLat, eastLng, northLat]`).
+   * @param zoom Zoom level.
+   * @param out Result of a previous call to reuse.
+   */
+  getClustersColumnar(
+    bbox: GeoJSON.BBox,
+    zoom: number,
+    out?: Supercluster.ClusterColumns
+  ): Supercluster.ClusterColumns {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.getClustersColumnar(bbox, zoom, out);
+  }
+
+  /**
+   * Same as `getTile`, but returns the tile features as parallel typed
+   * arrays. Pass the previous result as `out` to reuse its arrays.
+   */
+  getTileColumnar(
+    zoom: number,
+    x: number,
+    y: number,
+    out?: Supercluster.TileColumns
+  ): Supercluster.TileColumns {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.getTileColumnar(zoom, x, y, out);
+  }
+
   /**
    * For a given zoom and x/y coordinates, returns a
    * [geojson-vt](https://github.com/mapbox/geojson-vt)-compatible JSON
@@ -114,6 +324,49 @@ export default class SuperclusterClass<
     return { features: this.clusterer.getTile(x, y, zoom) };
   }
 
+  /**
+   * Returns the tile of `getTile` encoded as a binary
+   * [Mapbox Vector Tile](https://github.com/mapbox/vector-tile-spec) with a
+   * single point layer, ready to be passed to a vector tile source.
+   *
+   * @param layerName Name of the layer, `clusters` by default.
+   */
+  getVectorTile(
+    zoom: number,
+    x: number,
+    y: number,
+    layerName?: string
+  ): ArrayBuffer {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.getVectorTile(zoom, x, y, layerName);
+  }
+
+  /**
+   * Returns the hit / miss counters and the current size of the tile cache
+   * (see the `tileCacheSize` option).
+   */
+  getTileCacheStats(): Supercluster.TileCacheStats {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.getTileCacheStats();
+  }
+
+  /**
+   * Returns whether `clusterId` names a cluster of this index, without
+   * throwing. Use it instead of catching the errors of `getChildren`,
+   * `getLeaves` and `getClusterExpansionZoom` for ids that do not. Cluster
+   * IDs are positions in the index, so an ID kept from before a reload or an
+   * update may still name a (different) cluster.
+   *
+   * @param clusterId Cluster ID (`cluster_id` value from feature properties).
+   */
+  hasCluster(clusterId: number): boolean {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.hasCluster(clusterId);
+  }
+
   /**
    * Returns the children of a cluster (on the next zoom level).
    *
@@ -148,6 +401,7 @@ export default class SuperclusterClass<
   /**
    * Returns the zoom level on which the cluster expands into several
    * children (useful for "click to zoom" feature).
+   * Clusters returned by queries carry it as `expansion_zoom`.
    *
    * @param clusterId Cluster ID (`cluster_id` value from feature properties).
    */
@@ -157,6 +411,34 @@ export default class SuperclusterClass<
     return this.clusterer.getClusterExpansionZoom(clusterId);
   }
 
+  /**
+   * Returns the bounding box `[west, south, east, north]` of all the points
+   * in a cluster, recorded while the index is built.
+   *
+   * @param clusterId Cluster ID (`cluster_id` value from feature properties).
+   * @throws {Error} If `clusterId` does not exist.
+   */
+  getClusterBounds(clusterId: number): GeoJSON.BBox {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.getClusterBounds(clusterId);
+  }
+
+  /**
+   * Returns the bounding boxes of every cluster and point of a
+   * `getClustersColumnar` / `getTileColumnar` result, as
+   * `[west, south, east, north]` quadruples (NaN for ids that no longer
+   * exist). Pass the previous result as `out` to reuse it.
+   */
+  getClustersBounds(
+    columns: Supercluster.Columns,
+    out?: Float64Array
+  ): Float64Array {
+    this.throwIfNotInitialized();
+
+    return this.clusterer.getClustersBounds(columns, out);
+  }
+
   /**
    * Returns a region containing the center of all the points in a cluster
    * and the delta value by which it should be zoomed out to see all the points.
@@ -166,32 +448,22 @@ export default class SuperclusterClass<
   getClusterExpansionRegion = (clusterId: number): Region => {
     this.throwIfNotInitialized();
 
-    const clusterMarkersCoordinates = this.getMarkersInCluster(clusterId).map(
-      getMarkersCoordinates
-    );
+    const [west, south, east, north] = this.getClusterBounds(clusterId);
 
-    return getMarkersRegion(clusterMarkersCoordinates);
+    return getMarkersRegion([
+      { latitude: south, longitude: west },
+      { latitude: north, longitude: east },
+    ]);
   };
 
   private throwIfNotInitialized(): void {
-    if (!this.clusterer) {
+    if (!this.loaded) {
       throw new Error(
         'React-Native-Clusterer: this Supercluster has not features. Use the load() method to add features.'
       );
     }
   }
 
-  private getMarkersInCluster = (
-    clusterId: number
-  ): Array<Supercluster.PointFeature<GeoJSON.GeoJsonProperties>> => {
-    const clusterChildren = this.getChildren(clusterId);
-
-    if (clusterChildren.length > 1) {
-      return clusterChildren;
-    }
-    return this.getMarkersInCluster(clusterChildren[0]!.id as number);
-  };
-
   private addExpansionRegionToCluster = (
     feature: Supercluster.PointFeature<P> | Supercluster.ClusterFeatureBase<C>
   ) => {
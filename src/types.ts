@@ -65,6 +65,40 @@ declare namespace Supercluster {
      * @default false
      */
     generateId?: boolean;
+    /**
+     * Number of threads used to build the index. Every zoom level is split
+     * into spatial partitions that are clustered concurrently, the result
+     * is identical to a single-threaded build. Use `0` for one thread per
+     * CPU core.
+     *
+     * @default 1
+     */
+    threads?: number;
+    /**
+     * Coordinate storage of the native KD-trees. `'float'` and `'quantized'`
+     * (32-bit fixed point) use less memory than `'double'`, query results
+     * are identical.
+     *
+     * @default 'double'
+     */
+    indexPrecision?: 'double' | 'float' | 'quantized';
+    /**
+     * (Tiles) Approximate number of bytes of `getTile` results kept in a
+     * native least recently used cache, so tiles requested again are not
+     * recomputed. `0` disables the cache, see `getTileCacheStats` for sizing.
+     *
+     * @default 0
+     */
+    tileCacheSize?: number;
+    /**
+     * Build only the `maxZoom + 1` level when loading, and every other zoom
+     * level the first time a query reads it (with the levels between). Makes
+     * loading faster when only a few zoom levels are ever shown, the first
+     * query of a new zoom level is slower instead.
+     *
+     * @default false
+     */
+    lazyZooms?: boolean;
     /**
      * Size of the KD-tree leaf node. Affects performance.
      *
@@ -85,13 +119,23 @@ declare namespace Supercluster {
      */
     // map?: ((props: P) => C) | undefined;
     /**
-     * A reduce function that merges properties of two clusters into one.
+     * Cluster properties aggregated natively from numeric point properties.
+     * Each key is a cluster property, computed with an operator over the
+     * point property of the same name, or over another point property given
+     * as `[operator, property]`. A plain `'count'` counts the points.
+     * Points without a numeric value are left out, `min`, `max` and `mean`
+     * are omitted from clusters where no point has one.
      *
      * @example
-     * (accumulated, props) => { accumulated.sum += props.sum; }
+     * { revenue: 'sum', maxPrice: ['max', 'price'], visits: 'count' }
      */
-    // reduce?: ((accumulated: C, props: Readonly<C>) => void) | undefined;
+    reduce?: ReduceOptions;
   }
+  type ReduceOperator = 'sum' | 'min' | 'max' | 'count' | 'mean';
+  type ReduceOptions = Record<
+    string,
+    ReduceOperator | [ReduceOperator, string]
+  >;
   /**
    * Default properties type, allowing any properties.
    * Try to avoid this for better typesafety by using proper types.
@@ -120,6 +164,11 @@ declare namespace Supercluster {
      * is 1000 or greater (e.g. `1.3k` if the number is `1298`).
      */
     point_count_abbreviated: string;
+    /**
+     * Zoom on which the cluster expands into several children, as returned by
+     * `getClusterExpansionZoom`.
+     */
+    expansion_zoom: number;
   }
 
   type ClusterFeatureBase<C> = PointFeature<ClusterProperties & C>;
@@ -136,11 +185,54 @@ declare namespace Supercluster {
   interface TileFeature<C, P> {
     type: 1;
     geometry: Array<[number, number]>;
-    tags: (ClusterProperties & C) | P;
+    tags: (Omit<ClusterProperties, 'expansion_zoom'> & C) | P;
   }
   interface Tile<C, P> {
     features: Array<TileFeature<C, P>>;
   }
+  interface ClusterDiff<P, C> {
+    /** Clusters and points that entered the viewport. */
+    added: Array<ClusterFeature<C> | PointFeature<P>>;
+    /** Clusters and points that left it, as returned earlier in `added`. */
+    removed: Array<ClusterFeature<C> | PointFeature<P>>;
+    /** Number of clusters and points still visible. */
+    unchangedCount: number;
+  }
+  interface TileCacheStats {
+    /** Tiles served from the cache. */
+    hits: number;
+    /** Tiles computed, including those computed while the cache is off. */
+    misses: number;
+    /** Tiles currently cached. */
+    tiles: number;
+    /** Approximate size of the cached tiles in bytes. */
+    bytes: number;
+  }
+  /**
+   * Columnar query result: the first `length` elements of every array
+   * describe one cluster or point. The arrays may be longer, they are reused
+   * by passing the result back to the next query.
+   */
+  interface Columns {
+    length: number;
+    /** Number of points in the cluster, 1 for points. */
+    pointCount: Uint32Array;
+    /** Cluster ID of clusters, index in the loaded points of points. */
+    id: Uint32Array;
+    /** 1 for clusters, 0 for points. */
+    isCluster: Uint8Array;
+    /** `expansion_zoom` of clusters, 0 for points. */
+    expansionZoom: Uint8Array;
+  }
+  interface ClusterColumns extends Columns {
+    lng: Float64Array;
+    lat: Float64Array;
+  }
+  interface TileColumns extends Columns {
+    /** Tile coordinates, as in `TileFeature.geometry`. */
+    x: Int16Array;
+    y: Int16Array;
+  }
 }
 
 export type { Supercluster };
@@ -16,6 +16,9 @@ export function useClusterer<
   (Supercluster.PointFeature<P> | Supercluster.ClusterFeature<C>)[],
   SuperclusterClass<P, C>,
 ] {
+  // "reduce" is compared by value, so an inline object does not reload the index on every render
+  const reduceKey = JSON.stringify(options?.reduce ?? null);
+
   const [supercluster, setSupercluster] = useState(
     new SuperclusterClass(options).load(data)
   );
@@ -35,6 +38,11 @@ export function useClusterer<
     options?.minPoints,
     options?.minZoom,
     options?.maxZoom,
+    options?.threads,
+    options?.indexPrecision,
+    options?.tileCacheSize,
+    options?.lazyZooms,
+    reduceKey,
   ]);
 
   useEffect(() => {
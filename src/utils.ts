@@ -1,4 +1,3 @@
-import type { Feature, Point } from 'geojson';
 import type { Supercluster } from './types';
 import type { BBox, LatLng, Region } from './types';
 
@@ -56,16 +55,6 @@ export const getMarkersRegion = (points: LatLng[]): Region => {
   };
 };
 
-export const getMarkersCoordinates = (markers: Feature<Point>) => {
-  const [longitude, latitude] = markers.geometry.coordinates;
-  if (!longitude || !latitude) {
-    throw new Error(
-      `Invalid geometry coordinates: ${JSON.stringify(markers.geometry.coordinates)}`
-    );
-  }
-  return { longitude, latitude };
-};
-
 /**
  * Determines if a feature is a cluster for `.properties` typesafe accessiblity
  * @param point ClusterFeature or PointFeature